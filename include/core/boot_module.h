@@ -0,0 +1,42 @@
+#ifndef _CHEESOS2_CORE_BOOT_MODULE_H
+#define _CHEESOS2_CORE_BOOT_MODULE_H
+
+#include "core/multiboot.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The maximum length of a module name that is kept, including the terminating null byte.
+#define BOOT_MODULE_NAME_SIZE (64U)
+
+// Boot modules, such as an initial ramdisk passed with QEMU's `-initrd`, are loaded into physical memory by
+// the boot loader. They are never copied: their pages are reserved in the physical memory manager, and mapped
+// read-only into the kernel address space, so that their contents can be used in place.
+
+struct boot_module {
+    // Physical address and size in bytes of the module contents.
+    uintptr_t physical;
+    size_t size;
+
+    // The contents of the module in kernel address space, or NULL if the module is not mapped.
+    const void* data;
+
+    // The name or command line the boot loader gave to the module. This is copied, as the boot information
+    // is reclaimed after initialization.
+    char name[BOOT_MODULE_NAME_SIZE];
+};
+
+// Reserve the physical pages of the boot modules described by `mb`. This must be called directly after
+// `pmm_init`, before any page can be allocated.
+void boot_module_reserve(const struct multiboot* mb);
+
+// Map the boot modules read-only into kernel address space. This requires the virtual address allocator.
+void boot_module_map(void);
+
+// Return the number of boot modules.
+size_t boot_module_count(void);
+
+// Return the boot module with index `index`, which must be less than `boot_module_count()`.
+const struct boot_module* boot_module_get(size_t index);
+
+#endif
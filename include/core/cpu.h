@@ -0,0 +1,109 @@
+#ifndef _CHEESOS2_CORE_CPU_H
+#define _CHEESOS2_CORE_CPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdnoreturn.h>
+
+// Bits in control register 0.
+#define CPU_CR0_WP (1U << 16)
+
+// Bits in control register 4.
+#define CPU_CR4_PSE (1U << 4)
+#define CPU_CR4_PGE (1U << 7)
+
+// Processor features, as reported in edx by cpuid leaf 1. The value is the bit index.
+enum cpu_feature {
+    // 4 MiB pages.
+    CPU_FEATURE_PSE = 3,
+
+    // Time stamp counter.
+    CPU_FEATURE_TSC = 4,
+
+    // Global pages.
+    CPU_FEATURE_PGE = 13,
+
+    // MMX instructions.
+    CPU_FEATURE_MMX = 23,
+
+    // SSE instructions, including sfence.
+    CPU_FEATURE_SSE = 25,
+
+    // SSE2 instructions, including movnti.
+    CPU_FEATURE_SSE2 = 26,
+};
+
+// The processor as detected by `cpu_init`.
+struct cpu_features {
+    bool has_cpuid;
+
+    // Family, model and stepping from cpuid leaf 1. Without cpuid, the family is 3 for an i386 and 4
+    // for an i486, and the model and stepping are 0.
+    uint32_t family;
+    uint32_t model;
+    uint32_t stepping;
+
+    // The highest supported standard cpuid leaf.
+    uint32_t max_leaf;
+
+    // Vendor identification string, null-terminated. Empty without cpuid.
+    char vendor[13];
+
+    // Features reported in edx by leaf 1, indexed by `enum cpu_feature`.
+    uint32_t features_edx;
+};
+
+// Detect the processor and its features. Early i486 processors do not support cpuid, in which case
+// no features are reported. This also makes read-only pages apply to the kernel, which copy-on-write
+// relies on.
+void cpu_init(void);
+
+// Return the features of the processor. `cpu_init` must have been called.
+const struct cpu_features* cpu_get_features(void);
+
+// Check whether the processor supports a particular feature. `cpu_init` must have been called.
+bool cpu_has_feature(enum cpu_feature feature);
+
+static inline uint32_t cpu_read_cr0(void) {
+    uint32_t value;
+    asm volatile("mov %%cr0, %[value]" : [value] "=r" (value));
+    return value;
+}
+
+static inline void cpu_write_cr0(uint32_t value) {
+    asm volatile("mov %[value], %%cr0" : : [value] "r" (value) : "memory");
+}
+
+// Read the time stamp counter. Only use this after checking for `CPU_FEATURE_TSC`.
+static inline uint64_t cpu_read_tsc(void) {
+    uint64_t value;
+    asm volatile("rdtsc" : "=A" (value));
+    return value;
+}
+
+static inline uint32_t cpu_read_cr3(void) {
+    uint32_t value;
+    asm volatile("mov %%cr3, %[value]" : [value] "=r" (value));
+    return value;
+}
+
+// Note: Control register 4 does not exist on processors without cpuid. Only access it after
+// checking that the feature that requires it is present.
+static inline uint32_t cpu_read_cr4(void) {
+    uint32_t value;
+    asm volatile("mov %%cr4, %[value]" : [value] "=r" (value));
+    return value;
+}
+
+static inline void cpu_write_cr4(uint32_t value) {
+    asm volatile("mov %[value], %%cr4" : : [value] "r" (value) : "memory");
+}
+
+// Continue execution in `entry`, which may not return, on the stack that ends at `stack_top`. The current
+// stack is abandoned.
+static inline noreturn void cpu_switch_stack(void* stack_top, void (*entry)(void)) {
+    asm volatile("mov %[stack_top], %%esp\n\tcall *%[entry]" : : [stack_top] "r" (stack_top), [entry] "r" (entry) : "memory");
+    __builtin_unreachable();
+}
+
+#endif
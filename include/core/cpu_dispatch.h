@@ -0,0 +1,29 @@
+#ifndef _CHEESOS2_CORE_CPU_DISPATCH_H
+#define _CHEESOS2_CORE_CPU_DISPATCH_H
+
+// Operations of which the best implementation depends on the processor. Every entry starts out with an
+// implementation that works on any i386 or later, and `cpu_dispatch_init` replaces it with a faster one
+// if the features reported by `cpu_init` allow it.
+
+// Whole pages are zeroed and copied with non-temporal stores where available. Those bypass the cache, so
+// that filling a page which will not be read soon does not evict the working set. `memset` and `memcpy`
+// themselves are left alone, as they are mostly used on small buffers that are used right away.
+struct cpu_dispatch {
+    // Zero the page-aligned page at `page`.
+    void (*zero_page)(void* page);
+
+    // Copy the page at `src` to the page-aligned page at `dest`. The pages may not overlap.
+    void (*copy_page)(void* dest, const void* src);
+
+    // Remove the TLB entry of the page at `virtual`. Global pages are only guaranteed to be removed
+    // if invlpg is supported, which is the case on every processor that supports global pages.
+    void (*invalidate_page)(void* virtual);
+};
+
+extern struct cpu_dispatch CPU_DISPATCH;
+
+// Select the implementations of the operations above, and log which ones were chosen. This must be
+// called after `cpu_init`.
+void cpu_dispatch_init(void);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef _CHEESOS2_CORE_IDLE_H
+#define _CHEESOS2_CORE_IDLE_H
+
+#include <stdbool.h>
+
+// Perform a single unit of background work. This should be called repeatedly while the kernel is
+// waiting for something to happen, such as input.
+// Returns `true` if any work was done, and `false` if there is nothing left to do.
+bool idle_run(void);
+
+#endif
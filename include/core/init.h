@@ -0,0 +1,19 @@
+#ifndef _CHEESOS2_CORE_INIT_H
+#define _CHEESOS2_CORE_INIT_H
+
+// Code and data that are only used while the kernel initializes are placed in a separate part of the kernel
+// image, which is returned to the physical memory manager by `init_reclaim_memory` once initialization has
+// finished. Nothing marked with these may be used after that point.
+
+// Mark a function as only being called during initialization.
+#define __init __attribute__((section(".init_reclaim.text")))
+
+// Mark a variable as only being used during initialization. The variable may not be const.
+#define __initdata __attribute__((section(".init_reclaim.data")))
+
+// Return the memory used during boot to the physical memory manager: the bootstrap code, everything marked
+// `__init` or `__initdata`, the boot stack, and the boot page table if it was replaced. The kernel must
+// have switched away from the boot stack before this is called.
+void init_reclaim_memory(void);
+
+#endif
@@ -32,6 +32,18 @@ struct __attribute__((packed)) multiboot_mmap_entry {
     enum multiboot_mmap_type type;
 };
 
+// A boot module, loaded into physical memory by the boot loader together with the kernel.
+struct __attribute__((packed)) multiboot_module {
+    // Physical address range of the module contents. `mod_end` is exclusive.
+    uint32_t mod_start;
+    uint32_t mod_end;
+
+    // Command line or name given to the module by the boot loader.
+    const char* string;
+
+    uint32_t reserved;
+};
+
 struct __attribute__((packed)) multiboot {
     uint32_t flags;
 
@@ -43,7 +55,7 @@ struct __attribute__((packed)) multiboot {
     const char* cmdline;
 
     uint32_t mods_count;
-    void* mods_addr;
+    struct multiboot_module* mods_addr;
 
     union {
         struct {
@@ -118,4 +130,7 @@ enum multiboot_flags {
     MULTIBOOT_FLAG_FRAMEBUFFER_INFO = 4096
 };
 
+// Log the memory map provided by the boot loader.
+void multiboot_dump_mmap(const struct multiboot* mb);
+
 #endif
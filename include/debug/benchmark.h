@@ -0,0 +1,34 @@
+#ifndef _CHEESOS2_DEBUG_BENCHMARK_H
+#define _CHEESOS2_DEBUG_BENCHMARK_H
+
+#include <stdint.h>
+
+// Microbenchmarks of kernel primitives, run from the shell. Time is measured in processor cycles when the
+// time stamp counter is available, and in PIT ticks otherwise, so that the benchmarks also run on an i486.
+
+// Measures the total time of a number of short intervals.
+struct benchmark_timer {
+    uint32_t total;
+    uint32_t start;
+};
+
+// Prepare the time source. This must be called before any timer is used.
+void benchmark_init(void);
+
+// Return the unit of the measured times.
+const char* benchmark_unit(void);
+
+// Start measuring an interval. Intervals must be shorter than 54 ms when the PIT is used.
+void benchmark_start(struct benchmark_timer* timer);
+
+// Stop measuring an interval, and add it to the total of `timer`.
+void benchmark_stop(struct benchmark_timer* timer);
+
+// Compare `memset`, `memcpy` and `memmove` with plain byte loops, and print the results to the console.
+void benchmark_mem(void);
+
+// Compare `udivmod64` and the division by 10 used to format numbers with a bit-serial division, over random
+// operands, and print the results to the console.
+void benchmark_div(void);
+
+#endif
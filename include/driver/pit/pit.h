@@ -0,0 +1,23 @@
+#ifndef _CHEESOS2_DRIVER_PIT_PIT_H
+#define _CHEESOS2_DRIVER_PIT_PIT_H
+
+#include <stdint.h>
+
+// The programmable interval timer is present on every PC, so it can measure time on processors without
+// a time stamp counter. Only channel 0 is used, as a free running counter: its interrupt is masked.
+
+// The frequency at which the counters of the PIT count down.
+#define PIT_FREQUENCY (1193182U)
+
+// The I/O ports of the PIT.
+#define PIT_PORT_CHANNEL_0 (0x40)
+#define PIT_PORT_COMMAND (0x43)
+
+// Program channel 0 as a rate generator that counts down from 65535 to 0 and wraps, one step per tick.
+void pit_start_counter(void);
+
+// Read the current value of the channel 0 counter. Differences between two readings are in ticks of
+// `PIT_FREQUENCY`, modulo 65536, so intervals of up to 54 ms can be measured.
+uint16_t pit_read_counter(void);
+
+#endif
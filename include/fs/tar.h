@@ -0,0 +1,51 @@
+#ifndef _CHEESOS2_FS_TAR_H
+#define _CHEESOS2_FS_TAR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Read-only access to ustar archives that are held in memory in their entirety, such as an initial ramdisk.
+// Nothing is copied out of the archive except for the path of an entry: file contents are referred to
+// in place.
+
+// The maximum length of a path in a ustar archive, a 155 byte prefix and a 100 byte name joined by
+// a slash, including the terminating null byte.
+#define TAR_PATH_SIZE (257U)
+
+enum tar_entry_type {
+    TAR_ENTRY_FILE,
+    TAR_ENTRY_DIRECTORY,
+    TAR_ENTRY_OTHER,
+};
+
+struct tar_entry {
+    // The path of the entry, without a leading "./" or "/", and without a trailing slash.
+    char path[TAR_PATH_SIZE];
+
+    enum tar_entry_type type;
+
+    // The contents of the entry, pointing into the archive.
+    const void* data;
+    size_t size;
+};
+
+// Iterates over the entries of an archive in the order in which they are stored.
+struct tar_iterator {
+    const uint8_t* next;
+    const uint8_t* end;
+};
+
+// Start iterating over the archive of `size` bytes at `archive`.
+void tar_iterator_init(struct tar_iterator* it, const void* archive, size_t size);
+
+// Advance to the next entry, and store it in `entry`.
+// Returns `false` at the end of the archive, or when a header is corrupt or truncated.
+bool tar_iterator_next(struct tar_iterator* it, struct tar_entry* entry);
+
+// Find the regular file at `path` in the archive of `size` bytes at `archive`. A leading "./" or "/" in
+// `path` is ignored.
+// Returns `false` if the archive contains no such file.
+bool tar_find(const void* archive, size_t size, const char* path, struct tar_entry* entry);
+
+#endif
@@ -49,4 +49,7 @@ void idt_disable(void);
 void idt_make_interrupt_no_status(size_t interrupt, interrupt_no_status callback, enum idt_gate_type callback_type, enum idt_flag_type flags);
 void idt_make_interrupt_status(size_t interrupt, interrupt_status callback, enum idt_gate_type callback_type, enum idt_flag_type flags);
 
+// Make `interrupt` switch to the task with task state segment selector `selector`.
+void idt_make_task_gate(size_t interrupt, uint16_t selector, enum idt_flag_type flags);
+
 #endif
@@ -3,6 +3,24 @@
 
 #include <stdint.h>
 
+// Divide `dividend` by `divisor`, and store the remainder in `remainder` if it is not NULL. This uses one
+// or two `div` instructions, so that 64-bit division does not require libgcc.
+// Returns 0 if `divisor` is 0, in which case `remainder` is left alone.
 uint64_t udivmod64(uint64_t dividend, uint64_t divisor, uint64_t* remainder);
 
+// Divide `value` by 10, and store the remainder in `remainder`. This multiplies by a reciprocal instead
+// of dividing: 0xCCCCCCCD / 2^35 exceeds 1/10 by so little that the quotient is exact for every 32-bit value.
+static inline uint32_t udivmod32_10(uint32_t value, uint32_t* remainder) {
+    uint32_t quotient = (uint32_t) (((uint64_t) value * 0xCCCCCCCDU) >> 35);
+    *remainder = value - quotient * 10;
+    return quotient;
+}
+
+// Divide `value` by 100, and store the remainder in `remainder`. 0x51EB851F / 2^37 is exact in the same way.
+static inline uint32_t udivmod32_100(uint32_t value, uint32_t* remainder) {
+    uint32_t quotient = (uint32_t) (((uint64_t) value * 0x51EB851FU) >> 37);
+    *remainder = value - quotient * 100;
+    return quotient;
+}
+
 #endif
@@ -26,7 +26,7 @@ struct __attribute__((packed)) gdt_tss {
     uint32_t esp1;
     uint32_t ss1;
     uint32_t esp2;
-    uint16_t ss2;
+    uint32_t ss2;
     uint32_t cr3;
     uint32_t eip;
     uint32_t eflags;
@@ -49,6 +49,12 @@ struct __attribute__((packed)) gdt_tss {
     uint16_t iomap_base;
 };
 
+_Static_assert(sizeof(struct gdt_tss) == 104, "task state segment must match the processor layout");
+
+// Selectors of the task state segments.
+#define GDT_KERNEL_TSS_SELECTOR (0x28U)
+#define GDT_DOUBLE_FAULT_TSS_SELECTOR (0x30U)
+
 enum gdt_access_type {
     GDT_ACCESS_ACCESSED = 1 << 0,
     GDT_ACCESS_RW = 1 << 1,
@@ -76,6 +82,15 @@ void gdt_init(void);
 // Set the stack used on the next interrupt
 void gdt_set_int_stack(void* new_stack);
 
+// Set the function that runs in the double fault task. A task gate for the double fault exception switches
+// to this task, which has its own stack, so that a double fault caused by a kernel stack overflow can still
+// be reported. The error code is pushed onto the stack of the task. `entry` may not return.
+void gdt_set_double_fault_task(void (*entry)(void));
+
+// Return the task state segment of the kernel. When the double fault task is entered, this holds the state
+// of the code that faulted.
+const struct gdt_tss* gdt_get_kernel_tss(void);
+
 extern noreturn void gdt_jump_to_usermode(void* user_code, void* user_stack);
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef _CHEESOS2_MEMORY_HEAP_H
+#define _CHEESOS2_MEMORY_HEAP_H
+
+#include <stddef.h>
+
+// The kernel heap is a general purpose allocator for kernel memory. It grows by mapping physical pages
+// into the kernel heap area. Small allocations are served from pages which are divided into blocks of a
+// fixed size class, larger allocations get a span of whole pages.
+
+// The largest allocation that is served from a size class. Larger allocations take a span of pages.
+#define HEAP_MAX_SMALL_SIZE (1024U)
+
+// Allocate `size` bytes of kernel memory. The returned memory is aligned to at least 16 bytes.
+// Returns NULL if `size` is zero or if not enough memory is available.
+void* kmalloc(size_t size);
+
+// Return memory allocated by `kmalloc` to the kernel heap. Passing NULL has no effect.
+void kfree(void* ptr);
+
+// Allocate `pages` page-aligned pages from the kernel heap area, without any header. This is intended for
+// allocators that manage memory with their own bookkeeping, such as the slab allocator.
+// Returns NULL if not enough memory is available.
+void* heap_alloc_pages(size_t pages);
+
+// Return pages allocated by `heap_alloc_pages`. `pages` must be the number of pages that was allocated.
+void heap_free_pages(void* ptr, size_t pages);
+
+#endif
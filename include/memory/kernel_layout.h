@@ -7,6 +7,9 @@ extern void* kernel_virtual_start;
 extern void* kernel_virtual_end;
 extern void* kernel_physical_start;
 extern void* kernel_physical_end;
+extern void* kernel_bootstrap_physical_end;
+extern void* kernel_init_virtual_start;
+extern void* kernel_init_virtual_end;
 
 #define KERNEL_VIRTUAL_START ((uintptr_t) &kernel_virtual_start)
 #define KERNEL_VIRTUAL_END ((uintptr_t) &kernel_virtual_end)
@@ -14,6 +17,29 @@ extern void* kernel_physical_end;
 #define KERNEL_PHYSICAL_START ((uintptr_t) &kernel_physical_start)
 #define KERNEL_PHYSICAL_END ((uintptr_t) &kernel_physical_end)
 
+// The bootstrap code runs before paging is enabled, and starts at `KERNEL_PHYSICAL_START`.
+#define KERNEL_BOOTSTRAP_PHYSICAL_END ((uintptr_t) &kernel_bootstrap_physical_end)
+
+// The part of the kernel image that is reclaimed after initialization, see `core/init.h`.
+#define KERNEL_INIT_VIRTUAL_START ((uintptr_t) &kernel_init_virtual_start)
+#define KERNEL_INIT_VIRTUAL_END ((uintptr_t) &kernel_init_virtual_end)
+
+// The physical memory map maps physical memory linearly from `KERNEL_VIRTUAL_START` up to this address.
+#define KERNEL_PHYSMAP_END ((uintptr_t) 0xD0000000)
+
+// The range of virtual memory reserved for the kernel heap.
+#define KERNEL_HEAP_START ((uintptr_t) 0xD0000000)
+#define KERNEL_HEAP_END ((uintptr_t) 0xE0000000)
+
+// The range of virtual memory handed out by the kernel virtual address allocator.
+#define KERNEL_VADDR_START ((uintptr_t) 0xE0000000)
+#define KERNEL_VADDR_END ((uintptr_t) 0xFF800000)
+
+// The range of virtual memory used by the virtual memory manager for short-lived mappings. This ends
+// where the recursive page table is mapped.
+#define KERNEL_TEMP_MAP_START ((uintptr_t) 0xFF800000)
+#define KERNEL_TEMP_MAP_END ((uintptr_t) 0xFFC00000)
+
 // Returns valid pointers only for things contained in the kernel image
 // Any other virtual addresses added are invalid
 #define KERNEL_VIRTUAL_TO_PHYSICAL(ptr) ((void*) (uintptr_t) (ptr) - KERNEL_VIRTUAL_START)
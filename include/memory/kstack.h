@@ -0,0 +1,29 @@
+#ifndef _CHEESOS2_MEMORY_KSTACK_H
+#define _CHEESOS2_MEMORY_KSTACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Kernel stacks are allocated in the kernel virtual address space with unmapped guard pages below them,
+// so that a stack overflow faults instead of silently overwriting whatever lies below the stack. Pushing
+// onto a stack that has run into its guard page causes a double fault, which is handled on a separate
+// task with its own stack, see `gdt_set_double_fault_task`. This allows stacks to be kept small.
+
+// The number of unmapped pages below every kernel stack.
+#define KSTACK_GUARD_PAGES (1U)
+
+// The maximum number of kernel stacks that can exist at the same time.
+#define KSTACK_MAX (16U)
+
+// Allocate and map a kernel stack of `pages` pages.
+// Returns the top of the stack, or NULL if there is not enough memory or address space.
+void* kstack_alloc(size_t pages);
+
+// Free a stack allocated by `kstack_alloc`, given its top.
+void kstack_free(void* top);
+
+// Find the stack of which the guard pages contain `address`.
+// Returns the top of that stack, or NULL if `address` is not in a guard page.
+void* kstack_find_guard(uintptr_t address);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _CHEESOS2_MEMORY_MEMTAG_H
+#define _CHEESOS2_MEMORY_MEMTAG_H
+
+#include <stddef.h>
+
+// Physical memory usage is accounted per owner. Whoever allocates pages from the physical memory manager
+// adds them to the tag of what they are used for, and removes them again when they are freed. Updating
+// a tag takes constant time.
+
+enum memtag {
+    // The code and data of the kernel image, excluding the parts used by the physical memory manager.
+    MEMTAG_KERNEL_IMAGE,
+
+    // Metadata of the physical memory manager, such as the allocation bitmap.
+    MEMTAG_PMM,
+
+    // Page tables and page directories.
+    MEMTAG_PAGE_TABLE,
+
+    // Pages mapped in the kernel heap area, used by `kmalloc` and `heap_alloc_pages`.
+    MEMTAG_HEAP,
+
+    // Slab pages taken directly from the physical memory map.
+    MEMTAG_SLAB,
+
+    // Pages in the pool of pre-zeroed pages.
+    MEMTAG_ZERO_POOL,
+
+    // Pages mapped into regions on demand, and private copies of copy-on-write pages.
+    MEMTAG_REGION,
+
+    // Kernel stacks.
+    MEMTAG_STACK,
+
+    // Boot modules loaded by the boot loader, such as the initial ramdisk.
+    MEMTAG_BOOT_MODULE,
+
+    MEMTAG_COUNT,
+};
+
+extern const char* MEMTAG_NAMES[];
+
+// Usage of a single tag.
+struct memtag_stats {
+    // The number of pages currently accounted to the tag.
+    size_t pages;
+
+    // The highest value of `pages` so far.
+    size_t peak_pages;
+};
+
+// Account `pages` pages to `tag`.
+void memtag_add(enum memtag tag, size_t pages);
+
+// Remove `pages` pages from `tag`.
+void memtag_remove(enum memtag tag, size_t pages);
+
+// Retrieve the usage of `tag`.
+void memtag_get_stats(enum memtag tag, struct memtag_stats* stats);
+
+// Print the usage of all tags, the total and peak usage, and the fragmentation of free memory to the console.
+void memtag_print_stats(void);
+
+#endif
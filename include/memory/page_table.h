@@ -25,6 +25,11 @@
 
 #define IS_PAGE_ALIGNED(addr) ((addr) % PAGE_SIZE == 0)
 
+// A 4 MiB page, mapped directly by a page directory entry.
+#define HUGE_PAGE_SIZE (PAGE_SIZE * PAGE_TABLE_ENTRY_COUNT)
+#define HUGE_PAGE_OFFSET(addr) ((addr) & (HUGE_PAGE_SIZE - 1))
+#define HUGE_PAGE_ALIGN_FORWARD(addr) (ALIGN_FORWARD_2POW((addr), HUGE_PAGE_SIZE))
+
 struct __attribute__((packed)) page_dir_entry {
     uint8_t present : 1;
     uint8_t write_enable : 1;
@@ -34,7 +39,9 @@ struct __attribute__((packed)) page_dir_entry {
     uint8_t accessed : 1;
     uint8_t ignored0 : 1;
     uint8_t is_huge_page : 1;
-    uint8_t ignored1 : 4;
+    // Only used for 4 MiB pages, ignored otherwise.
+    uint8_t global : 1;
+    uint8_t ignored1 : 3;
     uint32_t page_table_address : 20;
 };
 
@@ -48,7 +55,9 @@ struct __attribute__((packed)) page_table_entry {
     uint8_t dirty : 1;
     uint8_t pat : 1;
     uint8_t global : 1;
-    uint8_t ignored : 3;
+    // Available to software: the page is shared read-only, and copied on the first write.
+    uint8_t copy_on_write : 1;
+    uint8_t ignored : 2;
     uint32_t page_address : 20;
 };
 
@@ -62,5 +71,6 @@ struct __attribute__((packed, aligned(PAGE_SIZE))) page_table {
 
 extern void pt_invalidate_tlb(void);
 extern void pt_invalidate_address(void* addr);
+extern void pt_load_directory(struct page_directory* physical);
 
 #endif
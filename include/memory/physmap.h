@@ -0,0 +1,40 @@
+#ifndef _CHEESOS2_MEMORY_PHYSMAP_H
+#define _CHEESOS2_MEMORY_PHYSMAP_H
+
+#include "memory/vmm.h"
+#include "memory/kernel_layout.h"
+#include "memory/page_table.h"
+
+#include "debug/assert.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The physical memory map is a permanent linear mapping of low physical memory, starting at
+// `KERNEL_VIRTUAL_START`, set up by `vmm_init_physmap`. Physical memory inside it can be accessed
+// directly, without creating a temporary mapping. It is empty until `vmm_init_physmap` is called.
+
+// Check whether the physical page with index `page` is accessible through the physical memory map.
+static inline bool physmap_contains_page(uintptr_t page) {
+    return page < vmm_physmap_pages();
+}
+
+// Check whether a virtual address lies within the physical memory map.
+static inline bool physmap_contains_virtual(const void* virtual) {
+    uintptr_t vaddr = (uintptr_t) virtual;
+    return vaddr >= KERNEL_VIRTUAL_START && physmap_contains_page(PAGE_INDEX(vaddr - KERNEL_VIRTUAL_START));
+}
+
+// Return the address in the physical memory map of a physical address.
+static inline void* phys_to_virt(uintptr_t physical) {
+    assert(physmap_contains_page(PAGE_INDEX(physical)));
+    return (void*) (KERNEL_VIRTUAL_START + physical);
+}
+
+// Return the physical address of an address in the physical memory map.
+static inline uintptr_t virt_to_phys(const void* virtual) {
+    assert(physmap_contains_virtual(virtual));
+    return (uintptr_t) virtual - KERNEL_VIRTUAL_START;
+}
+
+#endif
@@ -4,15 +4,36 @@
 #include "core/multiboot.h"
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 // The physical memory manager keeps a cache of physical pages so that a new page may
 // be assigned relatively quickly in most cases. This is the number of elements in it.
 #define PMM_PAGE_STACK_ENTRIES (1024U)
 
+// Pages are moved between the cache and the rest of the allocator in batches of this many pages. This
+// bounds the time a single allocation or free spends on the cache.
+#define PMM_PAGE_STACK_BATCH (32U)
+
+// The watermarks of the cache: an allocation that finds no more than `PMM_PAGE_STACK_LOW` pages in it
+// first refills it by one batch, and a free that finds at least `PMM_PAGE_STACK_HIGH` pages in it first
+// returns one batch. Between the two, allocations and frees only touch the cache, so alternating them
+// never moves pages back and forth.
+#define PMM_PAGE_STACK_LOW (PMM_PAGE_STACK_BATCH)
+#define PMM_PAGE_STACK_HIGH (PMM_PAGE_STACK_ENTRIES - PMM_PAGE_STACK_BATCH)
+
+// The largest order of block that can be allocated using `pmm_alloc_order`. A block of order `n`
+// consists of 2^n pages, so this corresponds to 4 MiB.
+#define PMM_MAX_ORDER (10U)
+
 // Check whether the result of `pmm_alloc` is a valid page index
 #define PMM_ALLOC_FAILED(result) ((result) < 0)
 
+// Two implementations of the physical memory manager are available, which one is used is selected
+// at build time. Both implement this interface.
+// - The bitmap allocator keeps one bit per page, and a cache of free pages for fast single page allocation.
+// - The buddy allocator keeps free lists of blocks of 2^n pages, which are coalesced when freed.
+
 // Initialize the physical memory manager, according to the memory map provided in `multiboot`.
 // This function assumes that there is no virtual memory mapped other than the kernel.
 // Initially, the internal cache of pages will be cleared. Additional memory areas can be mapped
@@ -33,7 +54,8 @@ size_t pmm_total_pages(void);
 // directly after `pmm_init`, and should be called sparingly otherwise.
 void pmm_mark_reserved(uintptr_t page);
 
-// Check whether a particular page index is currently free for allocation.
+// Check whether a particular page index is currently free for allocation. This may need to search the
+// internal cache of pages, so it should not be used on hot paths.
 bool pmm_is_free(uintptr_t page);
 
 // Allocate a physical page.
@@ -43,4 +65,120 @@ intptr_t pmm_alloc(void);
 // Return a physical page index to the system memory pool.
 void pmm_free(uintptr_t page);
 
+// Allocate `count` physically contiguous pages, of which the first page index is a multiple of `align_pages`.
+// `align_pages` must be a power of two. This searches the allocation bitmap directly, and does not use
+// the internal cache of pages.
+// Returns the physical page index of the first page on success, or a negative value on failure.
+intptr_t pmm_alloc_contiguous(size_t count, size_t align_pages);
+
+// Return `count` contiguous pages starting at physical page index `page` to the system memory pool.
+// All of these pages must currently be allocated.
+void pmm_free_contiguous(uintptr_t page, size_t count);
+
+// Return the number of pages in the largest run of contiguous free pages. This requires a scan over the
+// allocation state of all pages, but allows callers of `pmm_alloc_contiguous` to fail fast.
+size_t pmm_largest_free_run(void);
+
+// Allocate a block of 2^`order` physically contiguous pages, of which the first page index is a multiple
+// of 2^`order`. `order` may be at most `PMM_MAX_ORDER`.
+// Returns the physical page index of the first page on success, or a negative value on failure.
+intptr_t pmm_alloc_order(unsigned order);
+
+// Return a block of 2^`order` pages previously allocated with `pmm_alloc_order` to the system memory pool.
+void pmm_free_order(uintptr_t page, unsigned order);
+
+// Log a report of how fragmented the free physical memory is.
+void pmm_log_fragmentation(void);
+
+// The number of buckets in the histogram of `pmm_alloc` latencies. Bucket 0 counts allocations that took
+// fewer than 2^`min_log2` time units, bucket `i` those that took [2^(i + n - 1), 2^(i + n)) units, and the
+// last bucket all allocations that took longer.
+#define PMM_LATENCY_BUCKETS (16U)
+
+// The smallest bucket boundary when the time is measured in processor cycles, and in PIT ticks. A PIT tick
+// takes dozens of cycles, so the buckets start lower for it.
+#define PMM_LATENCY_MIN_LOG2 (5U)
+#define PMM_LATENCY_PIT_MIN_LOG2 (0U)
+
+// Histogram of the time spent in the slow path of `pmm_alloc`: refilling the page stack in the bitmap
+// allocator, and splitting a larger block in the buddy allocator. The fast path is not measured, as without a
+// time stamp counter reading the clock takes several port accesses, which would cost more than the
+// allocation itself. The time is measured in processor cycles if the processor has a time stamp counter,
+// and in ticks of the PIT otherwise.
+struct pmm_latency_histogram {
+    uint32_t buckets[PMM_LATENCY_BUCKETS];
+
+    // The longest allocation seen so far.
+    uint32_t max_time;
+
+    // The unit of the times, and the log2 of the upper bound of bucket 0 in that unit.
+    const char* unit;
+    uint32_t min_log2;
+};
+
+// Select the time source of the latency histogram. This must be called after `cpu_init`, and before
+// `pmm_init`. If there is no time stamp counter, this starts the PIT.
+void pmm_latency_init(void);
+
+// Used by the backends to measure the slow path of `pmm_alloc`: `pmm_latency_start` returns a time stamp
+// which is passed to `pmm_latency_record` when the slow path is done.
+uint32_t pmm_latency_start(void);
+void pmm_latency_record(uint32_t start);
+
+// Retrieve the histogram of `pmm_alloc` latencies.
+void pmm_get_alloc_latency(struct pmm_latency_histogram* histogram);
+
+// The number of pre-zeroed pages that are kept available for `pmm_alloc_zeroed`.
+#define PMM_ZERO_POOL_ENTRIES (64U)
+
+// Counters of the pool of pre-zeroed pages.
+struct pmm_zero_stats {
+    // The number of calls to `pmm_alloc_zeroed` that were served from the pool.
+    uint32_t pool_hits;
+
+    // The number of calls to `pmm_alloc_zeroed` that had to zero a page synchronously.
+    uint32_t sync_zeroed;
+
+    // The number of pages zeroed in the background by `pmm_zero_idle`.
+    uint32_t idle_zeroed;
+
+    // The number of pages currently in the pool.
+    uint32_t pool_pages;
+};
+
+// Allocate a physical page which is filled with zeroes. Pages are taken from a pool of pages which
+// are zeroed in the background, and zeroed on the spot if the pool is empty. This is independent of
+// the physical memory manager backend.
+// Returns a physical page index on success, or a negative value on failure.
+intptr_t pmm_alloc_zeroed(void);
+
+// Zero a single page and add it to the pool of pre-zeroed pages, if the pool is not full and enough
+// free memory is available. This is intended to be called when the system is idle.
+// Returns `true` if a page was zeroed.
+bool pmm_zero_idle(void);
+
+// Return the pages in the pool of pre-zeroed pages to the system memory pool.
+// Returns the number of pages that were released.
+size_t pmm_zero_drain(void);
+
+// Retrieve the counters of the pool of pre-zeroed pages.
+void pmm_get_zero_stats(struct pmm_zero_stats* stats);
+
+// Pages can be shared between address spaces, in which case they are reference counted. An allocated
+// page starts out with a single reference, which is owned by whoever allocated it. The counts are kept
+// independently of the physical memory manager backend.
+
+// Initialize the reference counts. This requires the region allocator.
+void pmm_ref_init(void);
+
+// Add a reference to an allocated page.
+void pmm_ref_page(uintptr_t page);
+
+// Drop a reference to an allocated page. The page is freed when the last reference is dropped.
+// Returns `true` if the page was freed.
+bool pmm_unref_page(uintptr_t page);
+
+// Return the number of references to an allocated page.
+size_t pmm_page_refs(uintptr_t page);
+
 #endif
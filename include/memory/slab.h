@@ -0,0 +1,74 @@
+#ifndef _CHEESOS2_MEMORY_SLAB_H
+#define _CHEESOS2_MEMORY_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The slab allocator keeps caches of fixed-size kernel objects. Every cache carves physical pages, accessed
+// through the physical memory map where possible, into slabs of equally sized objects, so that allocating
+// and freeing an object is a matter of popping or pushing an index. Objects are kept in their constructed
+// state while they are cached: the constructor runs once when a slab is created, and a freed object must be
+// returned in a state that is equivalent to a freshly constructed one.
+
+// The largest object size that a cache can be created for.
+#define KMEM_MAX_OBJECT_SIZE (512U)
+
+// The granularity with which the start of the objects in consecutive slabs is offset, so that objects
+// of different slabs do not all map to the same cache lines.
+#define KMEM_CACHE_LINE_SIZE (32U)
+
+// The maximum length of a cache name, including the terminating null byte.
+#define KMEM_CACHE_NAME_SIZE (16U)
+
+// Constructor called for every object when a new slab is created.
+typedef void (*kmem_ctor)(void* object);
+
+// Statistics of a single cache.
+struct kmem_cache_stats {
+    // The number of allocations that were served from an existing slab.
+    uint32_t hits;
+
+    // The number of allocations that required a new slab to be created.
+    uint32_t misses;
+
+    // The number of objects currently allocated from this cache.
+    uint32_t active_objects;
+
+    // The number of slabs currently owned by this cache, and how many of those have no objects allocated.
+    uint32_t slabs;
+    uint32_t empty_slabs;
+};
+
+struct kmem_cache;
+
+// Create a new cache for objects of `size` bytes, aligned to `align` bytes. `align` must be a power of two,
+// or zero for the default alignment. `ctor` may be NULL. `name` is copied, and truncated if it is too long.
+// Returns NULL if the cache could not be created.
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, size_t align, kmem_ctor ctor);
+
+// Destroy a cache. All objects allocated from the cache must have been freed.
+void kmem_cache_destroy(struct kmem_cache* cache);
+
+// Allocate an object from `cache`.
+// Returns NULL if there is not enough memory.
+void* kmem_cache_alloc(struct kmem_cache* cache);
+
+// Return an object to the cache it was allocated from.
+void kmem_cache_free(struct kmem_cache* cache, void* object);
+
+// Return the memory of all empty slabs of `cache` to the system.
+// Returns the number of pages that were released.
+size_t kmem_cache_reclaim(struct kmem_cache* cache);
+
+// Return the memory of the empty slabs of all caches to the system. This is called when the system
+// runs low on memory.
+// Returns the number of pages that were released.
+size_t kmem_reclaim(void);
+
+// Retrieve the statistics of `cache`.
+void kmem_cache_get_stats(const struct kmem_cache* cache, struct kmem_cache_stats* stats);
+
+// Print the statistics of all caches to the console.
+void kmem_print_stats(void);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef _CHEESOS2_MEMORY_VADDR_H
+#define _CHEESOS2_MEMORY_VADDR_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// The kernel virtual address allocator hands out page-aligned regions of the kernel address space
+// between `KERNEL_VADDR_START` and `KERNEL_VADDR_END`. It only manages addresses: mapping memory
+// into an allocated region is up to the caller.
+// Free regions are kept in two red-black trees: one ordered by base address, which is used to merge
+// a freed region with its neighbours, and one ordered by size, which is used to find the best fit.
+// Both allocating and freeing take O(log n) time in the number of free regions.
+
+// Initialize the virtual address allocator. This requires the slab allocator to be available.
+void vaddr_init(void);
+
+// Allocate a region of `size` bytes of virtual address space. `size` must be a multiple of the page size.
+// Returns NULL if no free region of that size exists.
+void* vaddr_alloc(size_t size);
+
+// Return a region allocated by `vaddr_alloc` to the allocator. `size` must be the size that was allocated,
+// although it is also valid to free only a part of a region.
+void vaddr_free(void* base, size_t size);
+
+// Return the total amount of free virtual address space, in bytes.
+size_t vaddr_free_size(void);
+
+// Return the size of the largest free region, in bytes.
+size_t vaddr_largest_free(void);
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef _CHEESOS2_MEMORY_VM_REGION_H
+#define _CHEESOS2_MEMORY_VM_REGION_H
+
+#include "memory/address_range.h"
+#include "memory/vmm.h"
+
+#include "utility/containers/rbtree.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Regions describe parts of an address space that are backed by memory on demand. Creating a region only
+// reserves its addresses: physical pages are allocated and mapped one at a time, when the page fault handler
+// finds that a page of the region is touched for the first time. Memory is only spent on the pages of a large
+// buffer or stack that are actually used.
+
+// The maximum length of a region name, including the terminating null byte.
+#define VM_REGION_NAME_SIZE (16U)
+
+// Bits of the error code pushed by the processor on a page fault.
+enum vm_fault_status {
+    // The fault was caused by a protection violation, rather than by a page that is not present.
+    VM_FAULT_PRESENT = 0x01,
+
+    // The fault was caused by a write access.
+    VM_FAULT_WRITE = 0x02,
+
+    // The fault happened while the processor was in user mode.
+    VM_FAULT_USER = 0x04,
+};
+
+struct vm_region {
+    struct address_range range;
+
+    // Node in the region tree of the address space, ordered by base address.
+    struct rb_node node;
+
+    // The flags with which the pages of this region are mapped.
+    enum vmm_map_flags flags;
+
+    // The number of page faults that were handled by mapping a page into this region. Since a page is
+    // mapped on its first touch, this is also the number of pages of the region that are resident.
+    uint32_t faults;
+
+    char name[VM_REGION_NAME_SIZE];
+};
+
+// An address space, described by the non-overlapping regions in it.
+struct vm_space {
+    struct rb_tree regions;
+
+    // The number of page faults in this address space that did not belong to any region.
+    uint32_t unhandled_faults;
+};
+
+// Initialize the region allocator and the kernel address space. This requires the slab allocator.
+void vm_init(void);
+
+// Return the address space of the kernel.
+struct vm_space* vm_kernel_space(void);
+
+// Initialize an empty address space.
+void vm_space_init(struct vm_space* space);
+
+// Create a region covering `size` bytes at `base` in `space`. Both must be page-aligned, and the range must
+// not overlap any other region in the space. The pages are mapped with `flags` on first access. `name` is
+// copied, and truncated if it is too long.
+// Returns NULL if there is not enough memory.
+struct vm_region* vm_region_create(struct vm_space* space, const char* name, uintptr_t base, size_t size, enum vmm_map_flags flags);
+
+// Remove a region from `space`. All pages of the region that were mapped are unmapped, and freed unless
+// they are still shared with another address space.
+void vm_region_destroy(struct vm_space* space, struct vm_region* region);
+
+// Reserve `size` bytes of kernel virtual address space using the virtual address allocator, and create
+// a region for it in the kernel address space.
+// Returns NULL if there is not enough address space or memory.
+struct vm_region* vm_region_alloc_kernel(const char* name, size_t size, enum vmm_map_flags flags);
+
+// Destroy a region created by `vm_region_alloc_kernel`, and return its address space.
+void vm_region_free_kernel(struct vm_region* region);
+
+// Find the region in `space` which contains `address`.
+// Returns NULL if the address is not part of any region.
+struct vm_region* vm_region_find(struct vm_space* space, uintptr_t address);
+
+// Handle a page fault at `address` in `space`, with the error code `status` that was pushed by the processor.
+// Writes to copy-on-write pages are resolved as well, whether they are part of a region or not.
+// Returns `true` if the fault was resolved, and the faulting instruction can be restarted. Returns `false`
+// if the fault is not a first access to a page of a region or a copy-on-write fault, or if there is no memory.
+bool vm_handle_page_fault(struct vm_space* space, uintptr_t address, uint32_t status);
+
+// Print the regions of `space`, with their fault counts, to the console.
+void vm_space_print_stats(struct vm_space* space);
+
+#endif
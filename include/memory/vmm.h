@@ -3,11 +3,17 @@
 
 #include "memory/page_table.h"
 
+#include <stdint.h>
+#include <stdbool.h>
+
 // The page directory index in which the page directory is mapped to itself.
 // This should be some place other than where the kernel itself is going to be placed,
 // which is placed at address 0xC000000, index 768.
 #define VMM_RECUSIVE_PAGE_DIR_INDEX (PAGE_TABLE_ENTRY_COUNT - 1)
 
+// The number of entries in the TLB of the i486.
+#define VMM_TLB_ENTRIES (32U)
+
 // A structure representing the layout of the recusive page directory
 struct __attribute__((packed, aligned(PAGE_SIZE * 1024))) vmm_recursive_page_table {
     struct page_table page_tables[PAGE_TABLE_ENTRY_COUNT - 1];
@@ -36,11 +42,54 @@ enum vmm_result {
 
     // The virtual address was not mapped while unmapping or while translating.
     VMM_NOT_MAPPED,
+
+    // The virtual address is part of a 4 MiB page, which cannot be changed page by page.
+    VMM_HUGE_PAGE,
+};
+
+// Counters of the TLB invalidations performed by the virtual memory manager.
+struct vmm_tlb_stats {
+    // The number of single pages invalidated with `invlpg`.
+    uint32_t invlpg;
+
+    // The number of times the entire TLB was flushed.
+    uint32_t full_flushes;
+
+    // The number of page tables that were freed because they became empty.
+    uint32_t page_tables_freed;
+
+    // The number of full flushes that also had to drop global pages, by toggling CR4.PGE.
+    uint32_t global_flushes;
+
+    // The number of page directory switches, and how many of those kept the TLB entries of kernel pages
+    // because they are global. Each of the latter avoids at most `VMM_TLB_ENTRIES` TLB refills.
+    uint32_t directory_switches;
+    uint32_t global_switches;
+};
+
+// Counters of copy-on-write sharing between address spaces.
+struct vmm_cow_stats {
+    // The number of address spaces cloned with `vmm_clone_directory`.
+    uint32_t clones;
+
+    // The number of pages that were shared instead of copied while cloning.
+    uint32_t shared_pages;
+
+    // The number of writes to shared pages that were resolved by copying the page.
+    uint32_t copied_pages;
+
+    // The number of writes to copy-on-write pages that were no longer shared, and were made writable in place.
+    uint32_t reused_pages;
 };
 
 // Bootstrapping memory identity maps kernel memory. This function removes that mapping.
 void vmm_unmap_identity();
 
+// If the processor supports it, map the kernel part of the address space with global pages from now
+// on, and mark the existing kernel mappings global. Global pages stay in the TLB when the page directory
+// is switched. This requires `cpu_init` to be called, and the identity mapping to be removed.
+void vmm_init_global_pages(void);
+
 // To ease management of the page table, a recursive page table is used. This function retrieves the location of the
 // recursive page table.
 struct vmm_recursive_page_table* vmm_current_page_table();
@@ -55,16 +104,83 @@ struct vmm_recursive_page_table* vmm_current_page_table();
 enum vmm_result vmm_map_page(void* virtual, void* physical, enum vmm_map_flags flags);
 
 // Release the mapping of a virtual address. The corresponding page table
-// entry is cleared to all zeroes.
+// entry is cleared to all zeroes. If the page table becomes empty, it is freed. For a kernel page table,
+// this removes it from every page directory.
 // Returns:
 // - `VMM_SUCCESS` if no error occured, and the virtual address was successfully unmapped.
 // - `VMM_NOT_MAPPED` if the virtual address was not mapped at all.
 enum vmm_result vmm_unmap_page(void* virtual);
 
+// Map `pages` consecutive virtual pages starting at `virtual` to consecutive physical pages starting at
+// `physical`. Both addresses must be page-aligned. The page directory is consulted once per page table
+// rather than once per page, and TLB invalidations of overwritten mappings are batched.
+// Returns:
+// - `VMM_SUCCESS` if the entire range was successfully mapped.
+// - `VMM_OUT_OF_PHYSICAL_MEMORY` if page table memory was required but none is available.
+// - `VMM_ALREADY_MAPPED` if any page in the range was already mapped and `VMM_MAP_OVERWRITE` was not passed.
+// On failure, the pages of the range that were mapped by this call are unmapped again.
+enum vmm_result vmm_map_range(void* virtual, void* physical, size_t pages, enum vmm_map_flags flags);
+
+// Release the mappings of `pages` consecutive virtual pages starting at `virtual`. The TLB entries are
+// invalidated one by one for small ranges, and by flushing the entire TLB for larger ones. Page tables
+// that become empty are freed, as by `vmm_unmap_page`.
+// Returns:
+// - `VMM_SUCCESS` if all pages in the range were unmapped.
+// - `VMM_NOT_MAPPED` if some pages in the range were not mapped. The other pages are still unmapped.
+enum vmm_result vmm_unmap_range(void* virtual, size_t pages);
+
+// Map the first `pages` pages of physical memory at `KERNEL_VIRTUAL_START`, so that physical memory can
+// be accessed without temporary mappings. This includes the kernel image, which is mapped there already.
+// If the processor supports it, 4 MiB pages are used for this mapping, which replace the kernel page table
+// and greatly reduce the number of TLB entries needed for kernel accesses. Otherwise, regular page tables
+// are used. The map is limited to `KERNEL_PHYSMAP_END`. This requires the physical memory manager.
+void vmm_init_physmap(size_t pages);
+
+// Return the number of physical pages, starting from physical address 0, that are accessible through the
+// physical memory map. See also `memory/physmap.h`.
+size_t vmm_physmap_pages(void);
+
+// Free the static page table that was used to map the kernel image during boot, if `vmm_init_physmap`
+// replaced it with a 4 MiB page.
+// Returns the number of pages that were freed.
+size_t vmm_release_boot_page_table(void);
+
+// Fill the physical page with index `page` with zeroes. The page is accessed through the physical memory
+// map, or through a temporary mapping if it lies outside of it. This never allocates memory.
+void vmm_zero_page(uintptr_t page);
+
 // Translate a virtual address into a physical address.
 // Returns:
 // - `VMM_SUCCESS` if no error occured. `*physical` contains the target address.
 // - `VMM_NOT_MAPPED` if the virtual address was not mapped at all. `*physical` is not altered.
 enum vmm_result vmm_translate(void* virtual, void** physical);
 
+// Retrieve the TLB invalidation counters.
+void vmm_get_tlb_stats(struct vmm_tlb_stats* stats);
+
+// Create a copy of the current address space, without copying any memory. The user part of the address
+// space gets new page tables which map the same pages, and writable pages are made read-only and marked
+// copy-on-write in both address spaces. The first write to such a page is resolved by `vmm_handle_cow_fault`.
+// The kernel part of the address space is shared, and stays the same in all page directories.
+// Returns the physical page index of the new page directory, or a negative value if there was not enough
+// memory or too many page directories exist, in which case nothing was cloned.
+intptr_t vmm_clone_directory(void);
+
+// Free a page directory created by `vmm_clone_directory`, together with its user page tables, and drop its
+// references to the pages mapped in them. This must not be the current page directory.
+void vmm_release_directory(uintptr_t directory);
+
+// Resolve a write to a copy-on-write page at `virtual` in the current address space. If the page is still
+// shared, it is replaced by a private copy. Otherwise, it is made writable again.
+// Returns `true` if the write can be retried, and `false` if the page is not copy-on-write or if there is
+// not enough memory for the copy.
+bool vmm_handle_cow_fault(void* virtual);
+
+// Make the page directory with physical page index `directory` the current one. The TLB entries of kernel
+// pages are kept if they are global.
+void vmm_switch_directory(uintptr_t directory);
+
+// Retrieve the copy-on-write counters.
+void vmm_get_cow_stats(struct vmm_cow_stats* stats);
+
 #endif
@@ -0,0 +1,39 @@
+#ifndef _CHEESOS2_UTILITY_BITOPS_H
+#define _CHEESOS2_UTILITY_BITOPS_H
+
+#include <stdint.h>
+
+// Return the index of the least significant set bit of `x`.
+// `x` must not be zero. This compiles to a single `bsf` instruction.
+static inline unsigned bit_scan_forward(uint32_t x) {
+    return (unsigned) __builtin_ctz(x);
+}
+
+// Return the index of the most significant set bit of `x`.
+// `x` must not be zero. This compiles to a single `bsr` instruction.
+static inline unsigned bit_scan_reverse(uint32_t x) {
+    return 31U - (unsigned) __builtin_clz(x);
+}
+
+// Return the number of set bits in `x`.
+// Note: `__builtin_popcount` is not used here as it requires libgcc on targets without `popcnt`.
+static inline unsigned bit_count(uint32_t x) {
+    x = x - ((x >> 1) & 0x55555555U);
+    x = (x & 0x33333333U) + ((x >> 2) & 0x33333333U);
+    x = (x + (x >> 4)) & 0x0F0F0F0FU;
+    return (x * 0x01010101U) >> 24;
+}
+
+// Return a word with every byte set to `byte`.
+static inline uint32_t byte_broadcast(uint8_t byte) {
+    return byte * 0x01010101U;
+}
+
+// Return a mask with the high bit set for the first zero byte of `x` in memory order, which is the least
+// significant one. Bytes after it may be marked as well, but the mask is zero only if `x` contains no zero
+// byte. The index of the first zero byte is `bit_scan_forward(mask) / 8`.
+static inline uint32_t byte_zero_mask(uint32_t x) {
+    return (x - 0x01010101U) & ~x & 0x80808080U;
+}
+
+#endif
@@ -62,6 +62,11 @@ typedef int (*rb_find_cmp_fn)(void* lhs, struct rb_node* rhs);
 // with a node in order to find a value.
 struct rb_node* rb_find_by(struct rb_tree* tree, rb_find_cmp_fn cmp, void* value);
 
+// Find the first node (in in-order) for which `cmp(value, node)` is not positive, using a user-supplied
+// comparison function. `cmp` must be consistent with the order of the tree.
+// Returns `NULL` if `value` compares greater than all nodes in the tree.
+struct rb_node* rb_lower_bound_by(struct rb_tree* tree, rb_find_cmp_fn cmp, void* value);
+
 // A structure used for iterating (in in-order) over the nodes of a red-black tree.
 // The current node can be accessed using `it->node`.
 struct rb_iterator {
@@ -0,0 +1,100 @@
+#include "core/boot_module.h"
+#include "core/init.h"
+
+#include "memory/pmm.h"
+#include "memory/vmm.h"
+#include "memory/vaddr.h"
+#include "memory/page_table.h"
+#include "memory/memtag.h"
+
+#include "debug/assert.h"
+#include "debug/log.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// The bootstrap code copies at most this many module descriptors.
+#define BOOT_MODULE_MAX (16U)
+
+static struct {
+    struct boot_module modules[BOOT_MODULE_MAX];
+    size_t count;
+} BOOT_MODULE_STATE;
+
+__init void boot_module_reserve(const struct multiboot* mb) {
+    if (!(mb->flags & MULTIBOOT_FLAG_MODULES))
+        return;
+
+    size_t count = mb->mods_count < BOOT_MODULE_MAX ? mb->mods_count : BOOT_MODULE_MAX;
+    for (size_t i = 0; i < count; ++i) {
+        const struct multiboot_module* module = &mb->mods_addr[i];
+        if (module->mod_end < module->mod_start) {
+            log_warn("Ignoring boot module '%s' with invalid range", module->string);
+            continue;
+        }
+
+        struct boot_module* boot_module = &BOOT_MODULE_STATE.modules[BOOT_MODULE_STATE.count++];
+        *boot_module = (struct boot_module){
+            .physical = module->mod_start,
+            .size = module->mod_end - module->mod_start,
+            .data = NULL,
+        };
+
+        size_t name_len = strlen(module->string);
+        if (name_len >= BOOT_MODULE_NAME_SIZE)
+            name_len = BOOT_MODULE_NAME_SIZE - 1;
+        memcpy(boot_module->name, module->string, name_len);
+        boot_module->name[name_len] = '\0';
+
+        // Pages outside of available memory are never handed out anyway, so only the free ones need
+        // to be reserved.
+        uintptr_t begin_page = PAGE_INDEX(module->mod_start);
+        uintptr_t end_page = PAGE_INDEX(PAGE_ALIGN_FORWARD(module->mod_end));
+        size_t reserved = 0;
+        for (uintptr_t page = begin_page; page < end_page && page < pmm_total_pages(); ++page) {
+            if (pmm_is_free(page)) {
+                pmm_mark_reserved(page);
+                ++reserved;
+            }
+        }
+
+        memtag_add(MEMTAG_BOOT_MODULE, reserved);
+        log_info("Boot module '%s' at 0x%08X, %zu bytes", boot_module->name, boot_module->physical, boot_module->size);
+    }
+}
+
+__init void boot_module_map(void) {
+    for (size_t i = 0; i < BOOT_MODULE_STATE.count; ++i) {
+        struct boot_module* module = &BOOT_MODULE_STATE.modules[i];
+        if (module->size == 0)
+            continue;
+
+        uintptr_t physical_base = PAGE_ALIGN_BACKWARD(module->physical);
+        size_t offset = module->physical - physical_base;
+        size_t pages = PAGE_INDEX(PAGE_ALIGN_FORWARD(module->physical + module->size)) - PAGE_INDEX(physical_base);
+
+        uint8_t* virtual = vaddr_alloc(pages * PAGE_SIZE);
+        if (!virtual) {
+            log_error("Not enough address space to map boot module '%s'", module->name);
+            continue;
+        }
+
+        // The mapping is read-only, as the contents are shared with everything that looks into the module.
+        if (vmm_map_range(virtual, (void*) physical_base, pages, 0) != VMM_SUCCESS) {
+            log_error("Failed to map boot module '%s'", module->name);
+            vaddr_free(virtual, pages * PAGE_SIZE);
+            continue;
+        }
+
+        module->data = virtual + offset;
+    }
+}
+
+size_t boot_module_count(void) {
+    return BOOT_MODULE_STATE.count;
+}
+
+const struct boot_module* boot_module_get(size_t index) {
+    assert(index < BOOT_MODULE_STATE.count);
+    return &BOOT_MODULE_STATE.modules[index];
+}
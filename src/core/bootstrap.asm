@@ -16,8 +16,9 @@ EXTERN _fini
 
 GLOBAL _start
 
-SECTION .bss
-ALIGN 16
+; The boot stack is only used until the kernel switches to a stack allocated during initialization,
+; after which it is reclaimed.
+SECTION .init_reclaim.bss nobits alloc write noexec align=16
 kernel_stack_bottom:
 RESB 16*1024
 kernel_stack_top:
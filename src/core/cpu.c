@@ -0,0 +1,94 @@
+#include "core/cpu.h"
+#include "core/init.h"
+
+#include "debug/log.h"
+
+#include <stddef.h>
+
+// The alignment check flag in eflags does not exist on the i386, so it cannot be changed there.
+#define EFLAGS_AC (1U << 18)
+
+// The ID flag in eflags can only be changed by software if the processor supports cpuid.
+#define EFLAGS_ID (1U << 21)
+
+static struct cpu_features CPU_STATE;
+
+// Check whether `flag` in eflags can be changed. The original value is restored afterwards.
+static bool cpu_eflags_toggles(uint32_t flag) {
+    uint32_t original, toggled;
+    asm volatile(
+        "pushfl\n"
+        "pushfl\n"
+        "xorl %[flag], (%%esp)\n"
+        "popfl\n"
+        "pushfl\n"
+        "popl %[toggled]\n"
+        "movl (%%esp), %[original]\n"
+        "popfl\n"
+        : [original] "=r" (original), [toggled] "=r" (toggled)
+        : [flag] "r" (flag)
+        : "cc", "memory"
+    );
+    return ((original ^ toggled) & flag) != 0;
+}
+
+static void cpu_cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    asm volatile("cpuid" : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) : "a" (leaf), "c" (0));
+}
+
+__init void cpu_init(void) {
+    // Write protection is supported by every i486, so it does not depend on the features below.
+    cpu_write_cr0(cpu_read_cr0() | CPU_CR0_WP);
+
+    CPU_STATE.has_cpuid = cpu_eflags_toggles(EFLAGS_ID);
+    if (!CPU_STATE.has_cpuid) {
+        CPU_STATE.family = cpu_eflags_toggles(EFLAGS_AC) ? 4 : 3;
+        log_info("Processor does not support cpuid, family %u", CPU_STATE.family);
+        return;
+    }
+
+    uint32_t eax, ebx, ecx, edx;
+    cpu_cpuid(0, &eax, &ebx, &ecx, &edx);
+    CPU_STATE.max_leaf = eax;
+
+    // The vendor string is stored in ebx, edx, ecx, in that order.
+    uint32_t vendor[3] = {ebx, edx, ecx};
+    for (size_t i = 0; i < 12; ++i) {
+        CPU_STATE.vendor[i] = (char) (vendor[i / 4] >> (i % 4 * 8));
+    }
+    CPU_STATE.vendor[12] = 0;
+
+    if (CPU_STATE.max_leaf >= 1) {
+        cpu_cpuid(1, &eax, &ebx, &ecx, &edx);
+        CPU_STATE.features_edx = edx;
+
+        // The extended family and model only apply to family 15 and families 6 and 15, respectively.
+        CPU_STATE.stepping = eax & 0xF;
+        CPU_STATE.model = (eax >> 4) & 0xF;
+        CPU_STATE.family = (eax >> 8) & 0xF;
+        if (CPU_STATE.family == 6 || CPU_STATE.family == 15)
+            CPU_STATE.model |= ((eax >> 16) & 0xF) << 4;
+        if (CPU_STATE.family == 15)
+            CPU_STATE.family += (eax >> 20) & 0xFF;
+    } else {
+        // Leaf 1 was introduced after the i486 already supported cpuid.
+        CPU_STATE.family = 4;
+    }
+
+    log_info(
+        "Processor: %s, family %u, model %u, stepping %u, features: %08X",
+        CPU_STATE.vendor,
+        CPU_STATE.family,
+        CPU_STATE.model,
+        CPU_STATE.stepping,
+        CPU_STATE.features_edx
+    );
+}
+
+const struct cpu_features* cpu_get_features(void) {
+    return &CPU_STATE;
+}
+
+bool cpu_has_feature(enum cpu_feature feature) {
+    return (CPU_STATE.features_edx >> feature) & 1;
+}
@@ -0,0 +1,102 @@
+#include "core/cpu_dispatch.h"
+#include "core/cpu.h"
+#include "core/init.h"
+
+#include "memory/page_table.h"
+
+#include "debug/log.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static void cpu_zero_page_rep(void* page) {
+    memset(page, 0, PAGE_SIZE);
+}
+
+static void cpu_copy_page_rep(void* dest, const void* src) {
+    memcpy(dest, src, PAGE_SIZE);
+}
+
+// Zero a page with movnti, which only needs general purpose registers, so that no FPU or SSE state has
+// to be saved. The stores are combined in the write-combining buffers, and the final sfence makes them
+// visible before the page is handed out.
+static void cpu_zero_page_movnti(void* page) {
+    uint32_t* words = page;
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(uint32_t); i += 4) {
+        asm volatile(
+            "movnti %[zero], 0(%[words])\n"
+            "movnti %[zero], 4(%[words])\n"
+            "movnti %[zero], 8(%[words])\n"
+            "movnti %[zero], 12(%[words])\n"
+            :
+            : [words] "r" (words + i), [zero] "r" (0)
+            : "memory"
+        );
+    }
+
+    asm volatile("sfence" : : : "memory");
+}
+
+static void cpu_copy_page_movnti(void* dest, const void* src) {
+    uint32_t* dest_words = dest;
+    const uint32_t* src_words = src;
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(uint32_t); i += 4) {
+        asm volatile(
+            "movnti %[a], 0(%[dest])\n"
+            "movnti %[b], 4(%[dest])\n"
+            "movnti %[c], 8(%[dest])\n"
+            "movnti %[d], 12(%[dest])\n"
+            :
+            : [dest] "r" (dest_words + i),
+              [a] "r" (src_words[i]),
+              [b] "r" (src_words[i + 1]),
+              [c] "r" (src_words[i + 2]),
+              [d] "r" (src_words[i + 3])
+            : "memory"
+        );
+    }
+
+    asm volatile("sfence" : : : "memory");
+}
+
+static void cpu_invalidate_page_invlpg(void* virtual) {
+    pt_invalidate_address(virtual);
+}
+
+// invlpg was introduced with the i486. Reloading CR3 flushes the entire TLB instead, which is correct
+// as long as there are no global pages, and those do not exist on the i386 either.
+static void cpu_invalidate_page_cr3(void* virtual) {
+    (void) virtual;
+    pt_invalidate_tlb();
+}
+
+struct cpu_dispatch CPU_DISPATCH = {
+    .zero_page = cpu_zero_page_rep,
+    .copy_page = cpu_copy_page_rep,
+    .invalidate_page = cpu_invalidate_page_invlpg,
+};
+
+__init void cpu_dispatch_init(void) {
+    const struct cpu_features* features = cpu_get_features();
+
+    // movnti is part of SSE2, while sfence is part of SSE, which SSE2 implies.
+    bool non_temporal = cpu_has_feature(CPU_FEATURE_SSE2);
+    if (non_temporal) {
+        CPU_DISPATCH.zero_page = cpu_zero_page_movnti;
+        CPU_DISPATCH.copy_page = cpu_copy_page_movnti;
+    }
+
+    bool invlpg = features->family >= 4;
+    if (!invlpg)
+        CPU_DISPATCH.invalidate_page = cpu_invalidate_page_cr3;
+
+    log_info("Page zeroing and copying: %s", non_temporal ? "movnti" : "rep stosd/movsd");
+    log_info("TLB invalidation: %s", invlpg ? "invlpg" : "CR3 reload");
+    log_info(
+        "4 MiB pages: %s, global pages: %s",
+        cpu_has_feature(CPU_FEATURE_PSE) ? "yes" : "no",
+        cpu_has_feature(CPU_FEATURE_PGE) ? "yes" : "no"
+    );
+}
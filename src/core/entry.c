@@ -3,12 +3,19 @@
 
 #include "core/multiboot.h"
 #include "core/panic.h"
+#include "core/cpu.h"
+#include "core/cpu_dispatch.h"
+#include "core/boot_module.h"
+#include "core/init.h"
 #include "interrupt/idt.h"
 #include "interrupt/pic.h"
 
 #include "memory/gdt.h"
 #include "memory/pmm.h"
 #include "memory/vmm.h"
+#include "memory/vaddr.h"
+#include "memory/vm_region.h"
+#include "memory/kstack.h"
 
 #include "driver/vga/text.h"
 #include "driver/serial/serial.h"
@@ -43,12 +50,33 @@ static void syscall_handler(uint32_t interrupt, struct interrupt_registers* regi
     log_info("Syscall interrupt");
 }
 
+// The number of pages of the stack used when an interrupt switches from user mode to kernel mode. An overflow
+// runs into the guard page below the stack, so this does not need a safety margin.
+#define INTERRUPT_STACK_PAGES (2U)
+
+// The number of pages of the stack the kernel runs on after initialization, which replaces the boot stack.
+#define KERNEL_STACK_PAGES (4U)
+
 static void test_usermode() {
     asm volatile ("int $'B'");
     *(volatile int*)0;
 }
 
-void kernel_main(const struct multiboot* multiboot) {
+// The part of the kernel that runs after initialization, on the kernel stack.
+static noreturn void kernel_run(void) {
+    init_reclaim_memory();
+
+    //log_info("Jumping to usercode at %p", (void*) test_usermode);
+    //gdt_jump_to_usermode((void*) test_usermode, (void*) 0xC0000000);
+    //log_info("Jumping to usercode at %p", (void*) shell_loop);
+    //gdt_jump_to_usermode((void*) shell_loop, (void*) 0xC0000000);
+    shell_loop();
+    
+    log_debug("End of entry.c");
+    kernel_panic();
+}
+
+__init void kernel_main(const struct multiboot* multiboot) {
     vmm_unmap_identity();
 
     serial_init(SERIAL_PORT_1, ((struct serial_init_info) {
@@ -61,6 +89,10 @@ void kernel_main(const struct multiboot* multiboot) {
 
     log_set_sink(sink_serial, NULL);
 
+    cpu_init();
+    cpu_dispatch_init();
+    vmm_init_global_pages();
+
     log_info("Initializing GDT");
     gdt_init();
 
@@ -82,7 +114,14 @@ void kernel_main(const struct multiboot* multiboot) {
         log_info("Booted with command line \"%s\"", multiboot->cmdline);
     }
 
+    pmm_latency_init();
     pmm_init(multiboot);
+    boot_module_reserve(multiboot);
+    vmm_init_physmap(pmm_total_pages());
+    vaddr_init();
+    boot_module_map();
+    vm_init();
+    pmm_ref_init();
 
     if (ps2_controller_init()) {
         log_error("PS2 initialization failed");
@@ -100,16 +139,23 @@ void kernel_main(const struct multiboot* multiboot) {
     console_print("\x90\x91\x91\x91\x91\x91\x91\x91\x91\x92\n");
     console_set_attr(VGA_ATTR_WHITE, VGA_ATTR_BLACK);
     
+    void* interrupt_stack = kstack_alloc(INTERRUPT_STACK_PAGES);
+    if (!interrupt_stack) {
+        log_error("Failed to allocate interrupt stack");
+        return;
+    }
+
+    void* kernel_stack = kstack_alloc(KERNEL_STACK_PAGES);
+    if (!kernel_stack) {
+        log_error("Failed to allocate kernel stack");
+        return;
+    }
+
     idt_disable();
     idt_make_interrupt_no_status('B', syscall_handler, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_3 | IDT_FLAG_PRESENT);
-    gdt_set_int_stack((void*) 0xC0001000);
+    gdt_set_int_stack(interrupt_stack);
     idt_enable();
-    
-    //log_info("Jumping to usercode at %p", (void*) test_usermode);
-    //gdt_jump_to_usermode((void*) test_usermode, (void*) 0xC0000000);
-    //log_info("Jumping to usercode at %p", (void*) shell_loop);
-    //gdt_jump_to_usermode((void*) shell_loop, (void*) 0xC0000000);
-    shell_loop();
-    
-    log_debug("End of entry.c");
+
+    // The boot stack is reclaimed together with the rest of the boot memory, so leave it for good.
+    cpu_switch_stack(kernel_stack, kernel_run);
 }
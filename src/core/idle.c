@@ -0,0 +1,7 @@
+#include "core/idle.h"
+
+#include "memory/pmm.h"
+
+bool idle_run(void) {
+    return pmm_zero_idle();
+}
@@ -0,0 +1,42 @@
+#include "core/init.h"
+
+#include "memory/pmm.h"
+#include "memory/vmm.h"
+#include "memory/kernel_layout.h"
+#include "memory/page_table.h"
+#include "memory/memtag.h"
+
+#include "debug/log.h"
+
+#include <string.h>
+
+// Fill with int3 instructions, so that a stray call into reclaimed code traps for as long as the page
+// has not been reused.
+#define INIT_POISON (0xCC)
+
+// Return the pages of the kernel image between the physical addresses `begin` and `end` to the physical
+// memory manager. The kernel image is part of the physical memory map, so the pages stay mapped there.
+// Returns the number of pages that were freed.
+static size_t init_reclaim_range(uintptr_t begin, uintptr_t end) {
+    uintptr_t begin_page = PAGE_INDEX(PAGE_ALIGN_FORWARD(begin));
+    uintptr_t end_page = PAGE_INDEX(PAGE_ALIGN_BACKWARD(end));
+    if (begin_page >= end_page)
+        return 0;
+
+    memset(KERNEL_PHYSICAL_TO_VIRTUAL(begin_page << PAGE_OFFSET_BITS), INIT_POISON, (end_page - begin_page) * PAGE_SIZE);
+    pmm_free_contiguous(begin_page, end_page - begin_page);
+    return end_page - begin_page;
+}
+
+void init_reclaim_memory(void) {
+    size_t pages = 0;
+    pages += init_reclaim_range(KERNEL_PHYSICAL_START, KERNEL_BOOTSTRAP_PHYSICAL_END);
+    pages += init_reclaim_range(
+        (uintptr_t) KERNEL_VIRTUAL_TO_PHYSICAL(KERNEL_INIT_VIRTUAL_START),
+        (uintptr_t) KERNEL_VIRTUAL_TO_PHYSICAL(KERNEL_INIT_VIRTUAL_END)
+    );
+    pages += vmm_release_boot_page_table();
+
+    memtag_remove(MEMTAG_KERNEL_IMAGE, pages);
+    log_info("Reclaimed %zu KiB of boot memory", pages * (PAGE_SIZE / 1024));
+}
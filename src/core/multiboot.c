@@ -1,5 +1,8 @@
 #include "core/multiboot.h"
+#include "core/init.h"
 #include "memory/kernel_layout.h"
+#include "memory/page_table.h"
+#include "debug/log.h"
 #include <stddef.h>
 
 #define MULTIBOOT_MAGIC_NUMBER (0x1BADB002)
@@ -14,12 +17,17 @@ const struct multiboot_header header __attribute__((section(".multiboot"))) = {
 #define MAX_CMDLINE (256)
 #define MAX_BOOT_LOADER_NAME (64)
 #define MAX_ENTRIES (64)
+#define MAX_MODULES (16)
+#define MAX_MODULE_STRING (64)
 
-static char cmdline[MAX_CMDLINE];
-static char boot_loader_name[MAX_BOOT_LOADER_NAME];
-static struct multiboot_mmap_entry mmap_entries[MAX_ENTRIES];
+// The copies of the boot information are only used during initialization, after which they are reclaimed.
+__initdata static char cmdline[MAX_CMDLINE];
+__initdata static char boot_loader_name[MAX_BOOT_LOADER_NAME];
+__initdata static struct multiboot_mmap_entry mmap_entries[MAX_ENTRIES];
+__initdata static struct multiboot_module modules[MAX_MODULES];
+__initdata static char module_strings[MAX_MODULES][MAX_MODULE_STRING];
 
-static struct multiboot bootstrap_multiboot;
+__initdata static struct multiboot bootstrap_multiboot;
 
 __attribute__((section(".bootstrap.text")))
 struct multiboot* multiboot_bootstrap(struct multiboot* multiboot) {
@@ -27,6 +35,8 @@ struct multiboot* multiboot_bootstrap(struct multiboot* multiboot) {
     char* physical_cmdline = KERNEL_VIRTUAL_TO_PHYSICAL(&cmdline);
     char* physical_boot_loader_name = KERNEL_VIRTUAL_TO_PHYSICAL(&boot_loader_name);
     struct multiboot_mmap_entry* physical_mmap_entries = KERNEL_VIRTUAL_TO_PHYSICAL(&mmap_entries);
+    struct multiboot_module* physical_modules = KERNEL_VIRTUAL_TO_PHYSICAL(&modules);
+    char (*physical_module_strings)[MAX_MODULE_STRING] = KERNEL_VIRTUAL_TO_PHYSICAL(&module_strings);
 
     // TODO: Add other fields as needed
     *physical_bootstrap_multiboot = (struct multiboot){
@@ -82,5 +92,68 @@ struct multiboot* multiboot_bootstrap(struct multiboot* multiboot) {
         physical_bootstrap_multiboot->mmap_addr = mmap_entries;
     }
 
+    // Only the module descriptors are copied. The contents stay where the boot loader put them, and
+    // are reserved in the physical memory manager later on.
+    if (multiboot->flags & MULTIBOOT_FLAG_MODULES) {
+        size_t count = multiboot->mods_count < MAX_MODULES ? multiboot->mods_count : MAX_MODULES;
+        for (size_t i = 0; i < count; ++i) {
+            const struct multiboot_module* module = &multiboot->mods_addr[i];
+            size_t j = 0;
+            if (module->string) {
+                for (; j < MAX_MODULE_STRING - 1; ++j) {
+                    if (!module->string[j]) {
+                        break;
+                    }
+                    physical_module_strings[i][j] = module->string[j];
+                }
+            }
+            physical_module_strings[i][j] = 0;
+
+            physical_modules[i] = (struct multiboot_module){
+                .mod_start = module->mod_start,
+                .mod_end = module->mod_end,
+                .string = module_strings[i],
+            };
+        }
+
+        physical_bootstrap_multiboot->flags |= MULTIBOOT_FLAG_MODULES;
+        physical_bootstrap_multiboot->mods_count = count;
+        physical_bootstrap_multiboot->mods_addr = modules;
+    }
+
     return &bootstrap_multiboot;
 }
+
+__init void multiboot_dump_mmap(const struct multiboot* mb) {
+    log_debug("Multiboot memory map dump:");
+    log_debug("address, size, type");
+    uintptr_t entry_addr = (uintptr_t) mb->mmap_addr;
+    uintptr_t entry_end = (uintptr_t) mb->mmap_addr + mb->mmap_length;
+    while (entry_addr < entry_end) {
+        const struct multiboot_mmap_entry* entry = (struct multiboot_mmap_entry*) entry_addr;
+        uint64_t addr = entry->addr;
+        uint64_t size = entry->len;
+
+        const char* type_name = "(invalid type)";
+        switch (entry->type) {
+            case MULTIBOOT_MMAP_AVAILABLE:
+                type_name = "available";
+                break;
+            case MULTIBOOT_MMAP_RESERVED:
+                type_name = "reserved";
+                break;
+            case MULTIBOOT_MMAP_ACPI:
+                type_name = "acpi";
+                break;
+            case MULTIBOOT_MMAP_ACPI_NVS:
+                type_name = "acpi nvs";
+                break;
+            case MULTIBOOT_MMAP_DEFECTIVE:
+                type_name = "defective";
+                break;
+        }
+
+        log_debug("0x%llX, %llu KiB (%llu pages), %s", addr, size / 1024, size / PAGE_SIZE, type_name);
+        entry_addr += entry->size + sizeof(entry->size);
+    }
+}
@@ -0,0 +1,270 @@
+#include "debug/benchmark.h"
+#include "debug/console/console.h"
+
+#include "core/cpu.h"
+#include "driver/pit/pit.h"
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+// The number of times every operation is repeated. The average time is reported.
+#define BENCHMARK_REPETITIONS (64U)
+
+// The largest buffer size that is benchmarked.
+#define BENCHMARK_MEM_MAX_SIZE (4096U)
+
+// The number of divisions timed as one interval.
+#define BENCHMARK_DIV_OPERANDS (64U)
+
+static bool BENCHMARK_USE_TSC = false;
+
+// Source and destination buffers, with room to offset them from their alignment.
+static uint8_t BENCHMARK_SRC[BENCHMARK_MEM_MAX_SIZE + 4] __attribute__((aligned(4)));
+static uint8_t BENCHMARK_DEST[BENCHMARK_MEM_MAX_SIZE + 4] __attribute__((aligned(4)));
+
+void benchmark_init(void) {
+    BENCHMARK_USE_TSC = cpu_has_feature(CPU_FEATURE_TSC);
+    if (!BENCHMARK_USE_TSC)
+        pit_start_counter();
+}
+
+const char* benchmark_unit(void) {
+    return BENCHMARK_USE_TSC ? "cycles" : "PIT ticks";
+}
+
+void benchmark_start(struct benchmark_timer* timer) {
+    timer->start = BENCHMARK_USE_TSC ? (uint32_t) cpu_read_tsc() : pit_read_counter();
+}
+
+void benchmark_stop(struct benchmark_timer* timer) {
+    if (BENCHMARK_USE_TSC) {
+        timer->total += (uint32_t) cpu_read_tsc() - timer->start;
+    } else {
+        // The PIT counts down.
+        timer->total += (uint16_t) (timer->start - pit_read_counter());
+    }
+}
+
+// The byte loops the string functions used to be. The compiler would otherwise recognize them, and replace
+// them with calls to the very functions they are compared with.
+__attribute__((optimize("no-tree-loop-distribute-patterns")))
+static void benchmark_byte_memset(void* dest, int ch, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        ((volatile uint8_t*) dest)[i] = ch;
+}
+
+__attribute__((optimize("no-tree-loop-distribute-patterns")))
+static void benchmark_byte_memcpy(void* dest, const void* src, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        ((volatile uint8_t*) dest)[i] = ((const uint8_t*) src)[i];
+}
+
+__attribute__((optimize("no-tree-loop-distribute-patterns")))
+static void benchmark_byte_memmove_backward(void* dest, const void* src, size_t count) {
+    while (count > 0) {
+        --count;
+        ((volatile uint8_t*) dest)[count] = ((const uint8_t*) src)[count];
+    }
+}
+
+enum benchmark_mem_op {
+    BENCHMARK_MEMSET,
+    BENCHMARK_MEMCPY,
+    BENCHMARK_MEMMOVE,
+};
+
+static const char* BENCHMARK_MEM_OP_NAMES[] = {
+    [BENCHMARK_MEMSET] = "memset",
+    [BENCHMARK_MEMCPY] = "memcpy",
+    [BENCHMARK_MEMMOVE] = "memmove",
+};
+
+// Time `op` on `size` bytes, with the destination `offset` bytes past a word boundary. The overlapping
+// `memmove` copies the buffer one word up within itself, which requires a backwards copy.
+static uint32_t benchmark_mem_op(enum benchmark_mem_op op, bool bytewise, size_t size, size_t offset) {
+    struct benchmark_timer timer = {};
+    uint8_t* dest = BENCHMARK_DEST + offset;
+
+    for (size_t i = 0; i < BENCHMARK_REPETITIONS; ++i) {
+        benchmark_start(&timer);
+        switch (op) {
+            case BENCHMARK_MEMSET:
+                if (bytewise) benchmark_byte_memset(dest, (int) i, size);
+                else memset(dest, (int) i, size);
+                break;
+            case BENCHMARK_MEMCPY:
+                if (bytewise) benchmark_byte_memcpy(dest, BENCHMARK_SRC, size);
+                else memcpy(dest, BENCHMARK_SRC, size);
+                break;
+            case BENCHMARK_MEMMOVE:
+                if (bytewise) benchmark_byte_memmove_backward(BENCHMARK_DEST + 4, dest, size);
+                else memmove(BENCHMARK_DEST + 4, dest, size);
+                break;
+        }
+        benchmark_stop(&timer);
+    }
+
+    return timer.total / BENCHMARK_REPETITIONS;
+}
+
+void benchmark_mem(void) {
+    static const size_t sizes[] = {16, 256, BENCHMARK_MEM_MAX_SIZE};
+
+    benchmark_init();
+    console_printf("average %s per call\n", benchmark_unit());
+    console_print("op      size   aligned: loop    current   unaligned: loop    current\n");
+
+    for (size_t op = BENCHMARK_MEMSET; op <= BENCHMARK_MEMMOVE; ++op) {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+            console_print(BENCHMARK_MEM_OP_NAMES[op]);
+            for (size_t j = strlen(BENCHMARK_MEM_OP_NAMES[op]); j < 8; ++j)
+                console_putchar(' ');
+
+            console_printf(
+                "%4zu %15u %10u %17u %10u\n",
+                sizes[i],
+                benchmark_mem_op(op, true, sizes[i], 0),
+                benchmark_mem_op(op, false, sizes[i], 0),
+                benchmark_mem_op(op, true, sizes[i], 1),
+                benchmark_mem_op(op, false, sizes[i], 1)
+            );
+        }
+    }
+}
+
+// The shift and subtract loop `udivmod64` used to be. It only terminates if shifting the divisor up to the
+// dividend does not overflow, so the benchmark keeps dividends below 2^62.
+static uint64_t benchmark_bitwise_udivmod64(uint64_t dividend, uint64_t divisor, uint64_t* remainder) {
+    uint64_t scaled_divisor = divisor;
+    uint64_t remain = dividend;
+    uint64_t result = 0;
+    uint64_t multiple = 1;
+
+    while (scaled_divisor < dividend) {
+        scaled_divisor <<= 1;
+        multiple <<= 1;
+    }
+
+    do {
+        if (remain >= scaled_divisor) {
+            remain -= scaled_divisor;
+            result += multiple;
+        }
+
+        scaled_divisor >>= 1;
+        multiple >>= 1;
+    } while (multiple != 0);
+
+    *remainder = remain;
+    return result;
+}
+
+enum benchmark_div_op {
+    BENCHMARK_DIV_32,
+    BENCHMARK_DIV_64,
+    BENCHMARK_DIV_10,
+    BENCHMARK_DIV_10_32,
+};
+
+static const char* BENCHMARK_DIV_OP_NAMES[] = {
+    [BENCHMARK_DIV_32] = "u64 / u32",
+    [BENCHMARK_DIV_64] = "u64 / u64",
+    [BENCHMARK_DIV_10] = "u64 / 10",
+    [BENCHMARK_DIV_10_32] = "u32 / 10",
+};
+
+static struct {
+    uint64_t dividends[BENCHMARK_DIV_OPERANDS];
+    uint64_t divisors[BENCHMARK_DIV_OPERANDS];
+} BENCHMARK_DIV_STATE;
+
+// Xorshift, which is good enough to pick operands.
+static uint32_t benchmark_random(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// Return a random number of `bits` bits or fewer. The length is random as well, since the time a
+// bit-serial division takes depends on it.
+static uint64_t benchmark_random_bits(uint32_t* state, unsigned bits) {
+    uint64_t value = ((uint64_t) benchmark_random(state) << 32) | benchmark_random(state);
+    unsigned length = 1 + benchmark_random(state) % bits;
+    return value >> (64 - length);
+}
+
+static void benchmark_div_operands(enum benchmark_div_op op) {
+    uint32_t state = 0x2545F491;
+    for (size_t i = 0; i < BENCHMARK_DIV_OPERANDS; ++i) {
+        uint64_t* dividend = &BENCHMARK_DIV_STATE.dividends[i];
+        uint64_t* divisor = &BENCHMARK_DIV_STATE.divisors[i];
+        switch (op) {
+            case BENCHMARK_DIV_32:
+                *dividend = benchmark_random_bits(&state, 62);
+                *divisor = benchmark_random_bits(&state, 32) | 1;
+                break;
+            case BENCHMARK_DIV_64:
+                *dividend = benchmark_random_bits(&state, 62);
+                *divisor = (1ULL << 32) | benchmark_random_bits(&state, 61);
+                break;
+            case BENCHMARK_DIV_10:
+                *dividend = benchmark_random_bits(&state, 62);
+                *divisor = 10;
+                break;
+            case BENCHMARK_DIV_10_32:
+                *dividend = benchmark_random_bits(&state, 32);
+                *divisor = 10;
+                break;
+        }
+    }
+}
+
+// Time all operands of `op` at once, either with the bit-serial loop or with the current division.
+static uint32_t benchmark_div_op(enum benchmark_div_op op, bool bitwise) {
+    struct benchmark_timer timer = {};
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < BENCHMARK_REPETITIONS; ++i) {
+        benchmark_start(&timer);
+        for (size_t j = 0; j < BENCHMARK_DIV_OPERANDS; ++j) {
+            uint64_t dividend = BENCHMARK_DIV_STATE.dividends[j];
+            uint64_t remainder;
+            if (bitwise) {
+                sum += benchmark_bitwise_udivmod64(dividend, BENCHMARK_DIV_STATE.divisors[j], &remainder);
+            } else if (op == BENCHMARK_DIV_10_32) {
+                uint32_t remainder32;
+                sum += udivmod32_10((uint32_t) dividend, &remainder32);
+                remainder = remainder32;
+            } else {
+                sum += udivmod64(dividend, BENCHMARK_DIV_STATE.divisors[j], &remainder);
+            }
+            sum += remainder;
+        }
+        benchmark_stop(&timer);
+    }
+
+    // Use the results, so that the divisions are not optimized away.
+    volatile uint64_t sink = sum;
+    (void) sink;
+    return timer.total / BENCHMARK_REPETITIONS;
+}
+
+void benchmark_div(void) {
+    benchmark_init();
+    console_printf("average %s per %u divisions\n", benchmark_unit(), BENCHMARK_DIV_OPERANDS);
+    console_print("op         bitwise    current\n");
+
+    for (size_t op = BENCHMARK_DIV_32; op <= BENCHMARK_DIV_10_32; ++op) {
+        benchmark_div_operands(op);
+        console_print(BENCHMARK_DIV_OP_NAMES[op]);
+        for (size_t j = strlen(BENCHMARK_DIV_OP_NAMES[op]); j < 9; ++j)
+            console_putchar(' ');
+
+        console_printf("%10u %10u\n", benchmark_div_op(op, true), benchmark_div_op(op, false));
+    }
+}
@@ -0,0 +1,25 @@
+#include "driver/pit/pit.h"
+
+#include "core/io.h"
+
+// Command bits: channel 0, access the low byte and then the high byte, mode 2 (rate generator), binary.
+#define PIT_COMMAND_CHANNEL_0_RATE (0x34)
+
+// Command bits: channel 0, latch the current count.
+#define PIT_COMMAND_CHANNEL_0_LATCH (0x00)
+
+void pit_start_counter(void) {
+    io_out8(PIT_PORT_COMMAND, PIT_COMMAND_CHANNEL_0_RATE);
+
+    // A reload value of 0 means 65536.
+    io_out8(PIT_PORT_CHANNEL_0, 0);
+    io_out8(PIT_PORT_CHANNEL_0, 0);
+}
+
+uint16_t pit_read_counter(void) {
+    // Latching makes sure that the two halves belong to the same count.
+    io_out8(PIT_PORT_COMMAND, PIT_COMMAND_CHANNEL_0_LATCH);
+    uint8_t low = io_in8(PIT_PORT_CHANNEL_0);
+    uint8_t high = io_in8(PIT_PORT_CHANNEL_0);
+    return (uint16_t) (high << 8 | low);
+}
@@ -0,0 +1,161 @@
+#include "fs/tar.h"
+
+#include "memory/align.h"
+
+#include <string.h>
+
+#define TAR_BLOCK_SIZE (512U)
+
+// Header of an entry in a ustar archive. All numeric fields are stored as octal ASCII strings.
+struct tar_header {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char type;
+    char link_name[100];
+    char magic[6];
+    char version[2];
+    char user_name[32];
+    char group_name[32];
+    char device_major[8];
+    char device_minor[8];
+    char prefix[155];
+    char padding[12];
+};
+
+_Static_assert(sizeof(struct tar_header) == TAR_BLOCK_SIZE, "tar header must fill a block");
+
+// Parse an octal field. Leading spaces are skipped, and the number ends at the first character that is not
+// an octal digit. Returns `false` if the field holds no digits, or if the value does not fit in `size_t`.
+static bool tar_parse_octal(const char* field, size_t length, size_t* value) {
+    size_t i = 0;
+    while (i < length && field[i] == ' ')
+        ++i;
+
+    size_t result = 0;
+    size_t digits = 0;
+    for (; i < length && field[i] >= '0' && field[i] <= '7'; ++i, ++digits) {
+        if (result >> (sizeof(size_t) * 8 - 3))
+            return false;
+        result = (result << 3) | (size_t) (field[i] - '0');
+    }
+
+    *value = result;
+    return digits > 0;
+}
+
+// The checksum is the sum of all bytes of the header, with the checksum field itself taken as spaces.
+static bool tar_check_header(const struct tar_header* header) {
+    size_t expected;
+    if (!tar_parse_octal(header->checksum, sizeof(header->checksum), &expected))
+        return false;
+
+    const uint8_t* bytes = (const uint8_t*) header;
+    size_t sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK_SIZE; ++i)
+        sum += bytes[i];
+
+    for (size_t i = 0; i < sizeof(header->checksum); ++i)
+        sum += ' ' - (uint8_t) header->checksum[i];
+
+    return sum == expected;
+}
+
+// Append the field of at most `length` bytes, which need not be null-terminated, to `path`.
+static size_t tar_append_field(char* path, size_t offset, const char* field, size_t length) {
+    for (size_t i = 0; i < length && field[i]; ++i)
+        path[offset++] = field[i];
+    return offset;
+}
+
+static const char* tar_strip_leading(const char* path) {
+    while (true) {
+        if (path[0] == '/') {
+            ++path;
+        } else if (path[0] == '.' && path[1] == '/') {
+            path += 2;
+        } else {
+            return path;
+        }
+    }
+}
+
+static void tar_build_path(const struct tar_header* header, char* path) {
+    char full[TAR_PATH_SIZE];
+    size_t length = 0;
+
+    // The prefix is only used by ustar archives. Older formats may store other data in that space.
+    if (!memcmp(header->magic, "ustar", 5) && header->prefix[0]) {
+        length = tar_append_field(full, length, header->prefix, sizeof(header->prefix));
+        full[length++] = '/';
+    }
+
+    length = tar_append_field(full, length, header->name, sizeof(header->name));
+    full[length] = '\0';
+
+    // The root of the archive, stored as "./", ends up as an empty path.
+    const char* stripped = tar_strip_leading(full);
+    length = strlen(stripped);
+    while (length > 0 && stripped[length - 1] == '/')
+        --length;
+
+    memcpy(path, stripped, length);
+    path[length] = '\0';
+}
+
+void tar_iterator_init(struct tar_iterator* it, const void* archive, size_t size) {
+    it->next = archive;
+    it->end = (const uint8_t*) archive + ALIGN_BACKWARD_2POW(size, TAR_BLOCK_SIZE);
+}
+
+bool tar_iterator_next(struct tar_iterator* it, struct tar_entry* entry) {
+    if (it->next == it->end)
+        return false;
+
+    // The archive ends with zero blocks, which also fail the checksum.
+    const struct tar_header* header = (const struct tar_header*) it->next;
+    size_t size;
+    if (!header->name[0] || !tar_check_header(header) || !tar_parse_octal(header->size, sizeof(header->size), &size))
+        return false;
+
+    const uint8_t* data = it->next + TAR_BLOCK_SIZE;
+    if (size > (size_t) (it->end - data))
+        return false;
+
+    switch (header->type) {
+        case '0':
+        case '\0':
+            entry->type = TAR_ENTRY_FILE;
+            break;
+        case '5':
+            entry->type = TAR_ENTRY_DIRECTORY;
+            break;
+        default:
+            entry->type = TAR_ENTRY_OTHER;
+            break;
+    }
+
+    tar_build_path(header, entry->path);
+    entry->data = data;
+    entry->size = size;
+
+    it->next = data + ALIGN_FORWARD_2POW(size, TAR_BLOCK_SIZE);
+    return true;
+}
+
+bool tar_find(const void* archive, size_t size, const char* path, struct tar_entry* entry) {
+    path = tar_strip_leading(path);
+
+    struct tar_iterator it;
+    tar_iterator_init(&it, archive, size);
+    while (tar_iterator_next(&it, entry)) {
+        if (entry->type == TAR_ENTRY_FILE && !strcmp(entry->path, path))
+            return true;
+    }
+
+    return false;
+}
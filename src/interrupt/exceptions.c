@@ -1,6 +1,9 @@
 #include "interrupt/exceptions.h"
 #include "interrupt/idt.h"
 #include "core/panic.h"
+#include "memory/vm_region.h"
+#include "memory/kstack.h"
+#include "memory/gdt.h"
 #include "debug/log.h"
 
 #include <stdint.h>
@@ -64,12 +67,47 @@ void idt_exception_status(uint32_t interrupt, struct interrupt_registers* regist
         uint32_t cr2;
         asm volatile ("mov %%cr2, %0" : "=r"(cr2));
         log_error("While accessing virtual address %p", cr2);
+        if (kstack_find_guard(cr2))
+            log_error("Address is in the guard page of the kernel stack ending at %p", kstack_find_guard(cr2));
     }
 
     idt_exception_dump_registers(registers, parameters);
     kernel_panic();
 }
 
+// Page faults on the first access to a page of a region are resolved by mapping the page. Any other page
+// fault is fatal.
+void idt_exception_page_fault(uint32_t interrupt, struct interrupt_registers* registers, struct interrupt_parameters* parameters, uint32_t status) {
+    uint32_t cr2;
+    asm volatile ("mov %%cr2, %0" : "=r"(cr2));
+    if (vm_handle_page_fault(vm_kernel_space(), cr2, status))
+        return;
+
+    idt_exception_status(interrupt, registers, parameters, status);
+}
+
+// Entry point of the double fault task. The processor switched to this task and its own stack, and saved
+// the state of the faulting code in the kernel task state segment. Returning is not possible, as the
+// fault cannot be recovered from.
+static noreturn void idt_exception_double_fault_task(void) {
+    const struct gdt_tss* tss = gdt_get_kernel_tss();
+    uint32_t cr2;
+    asm volatile ("mov %%cr2, %0" : "=r"(cr2));
+
+    log_error("Hardware exception %u (%s)", IDT_EXCEPTION_DOUBLE_FAULT, INTERRUPT_NAMES[IDT_EXCEPTION_DOUBLE_FAULT]);
+
+    // An overflowing stack faults when the processor tries to push the frame of the page fault, which
+    // turns the page fault into a double fault.
+    void* stack_top = kstack_find_guard(tss->esp - 1);
+    if (!stack_top)
+        stack_top = kstack_find_guard(cr2);
+    if (stack_top)
+        log_error("Kernel stack overflow on the stack ending at %p", stack_top);
+
+    log_error("EIP = 0x%08X, ESP = 0x%08X, CR2 = 0x%08X", tss->eip, tss->esp, cr2);
+    kernel_panic();
+}
+
 void idt_exceptions_load(void) {
     idt_make_interrupt_no_status(IDT_EXCEPTION_DIVIDE_ERROR, idt_exception_no_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
     //TODO: Debug
@@ -79,13 +117,14 @@ void idt_exceptions_load(void) {
     idt_make_interrupt_no_status(IDT_EXCEPTION_BOUND_RANGE, idt_exception_no_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
     idt_make_interrupt_no_status(IDT_EXCEPTION_INVALID_OPCODE, idt_exception_no_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
     idt_make_interrupt_no_status(IDT_EXCEPTION_DEVICE_NOT_AVAILABLE, idt_exception_no_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
-    idt_make_interrupt_status(IDT_EXCEPTION_DOUBLE_FAULT, idt_exception_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
+    gdt_set_double_fault_task(idt_exception_double_fault_task);
+    idt_make_task_gate(IDT_EXCEPTION_DOUBLE_FAULT, GDT_DOUBLE_FAULT_TSS_SELECTOR, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
     idt_make_interrupt_no_status(IDT_EXCEPTION_COPROC_SEGMENT_OVR, idt_exception_no_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
     idt_make_interrupt_status(IDT_EXCEPTION_INVALID_TSS, idt_exception_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
     idt_make_interrupt_status(IDT_EXCEPTION_SEGMENT_NOT_PRESENT, idt_exception_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
     idt_make_interrupt_status(IDT_EXCEPTION_STACK_SEGMENT_FAULT, idt_exception_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
     idt_make_interrupt_status(IDT_EXCEPTION_GENERAL_PROTECTION_FAULT, idt_exception_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
-    idt_make_interrupt_status(IDT_EXCEPTION_PAGE_FAULT, idt_exception_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
+    idt_make_interrupt_status(IDT_EXCEPTION_PAGE_FAULT, idt_exception_page_fault, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
     //TODO: Reserved
     idt_make_interrupt_no_status(IDT_EXCEPTION_X87, idt_exception_no_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
     idt_make_interrupt_status(IDT_EXCEPTION_ALIGNMENT, idt_exception_status, IDT_GATE_TYPE_INTERRUPT_32, IDT_PRIVILEGE_0 | IDT_FLAG_PRESENT);
@@ -1,6 +1,7 @@
 #include "interrupt/idt.h"
 #include "interrupt/exceptions.h"
 #include "memory/kernel_layout.h"
+#include "core/init.h"
 
 static struct idt_descriptor descriptor;
 static struct idt_entry entries[256];
@@ -36,7 +37,14 @@ void idt_make_interrupt_status(size_t interrupt, interrupt_status callback, enum
     idt_make_interrupt(interrupt, (void*)callback, callback_type, flags);
 }
 
-void idt_init(void) {
+void idt_make_task_gate(size_t interrupt, uint16_t selector, enum idt_flag_type flags) {
+    idt_callback_routines[interrupt] = NULL;
+
+    // The offset is not used by task gates.
+    idt_set_entry(&entries[interrupt], 0, selector, IDT_GATE_TYPE_TASK_32, flags);
+}
+
+__init void idt_init(void) {
     idt_create_handler_table(idt_hardware_callbacks);
 
     for(size_t i = 0; i < 256; ++i) {
@@ -34,6 +34,9 @@ interrupt_handler_no_status:
     ; save registers
     pusha
 
+    ; The interrupted code may have set the direction flag, but C code expects it to be clear
+    cld
+
     ; Restore kernel data segments
     mov ax, 0x10
     mov ds, ax
@@ -85,6 +88,9 @@ interrupt_handler_status:
     ; save registers
     pusha
 
+    ; The interrupted code may have set the direction flag, but C code expects it to be clear
+    cld
+
     ; Restore kernel data segments
     mov ax, 0x10
     mov ds, ax
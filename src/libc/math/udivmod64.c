@@ -1,33 +1,58 @@
 #include <math.h>
 
+#include "utility/bitops.h"
+
+// Divide `high:low` by `divisor` with a single `div` instruction. `high` must be less than `divisor`, so
+// that the quotient fits in 32 bits.
+static inline uint32_t udivmod64_32(uint32_t high, uint32_t low, uint32_t divisor, uint32_t* remainder) {
+    uint32_t quotient;
+    asm("divl %[divisor]" : "=a" (quotient), "=d" (*remainder) : "a" (low), "d" (high), [divisor] "rm" (divisor) : "cc");
+    return quotient;
+}
+
 uint64_t udivmod64(uint64_t dividend, uint64_t divisor, uint64_t* remainder) {
     if (divisor == 0) {
         return 0;
     }
 
-    uint64_t scaled_divisor = divisor;
-    uint64_t remain = dividend;
-    uint64_t result = 0;
-    uint64_t multiple = 1;
+    uint32_t dividend_high = (uint32_t) (dividend >> 32);
+    uint32_t divisor_high = (uint32_t) (divisor >> 32);
+    uint64_t quotient;
 
-    while (scaled_divisor < dividend) {
-        scaled_divisor <<= 1;
-        multiple <<= 1;
+    if (divisor_high == 0) {
+        // Long division in base 2^32. The remainder of the high half is below the divisor, so the
+        // second division cannot overflow.
+        uint32_t rem;
+        uint32_t quotient_high = udivmod64_32(0, dividend_high, (uint32_t) divisor, &rem);
+        uint32_t quotient_low = udivmod64_32(rem, (uint32_t) dividend, (uint32_t) divisor, &rem);
+        if (remainder) {
+            *remainder = rem;
+        }
+        return ((uint64_t) quotient_high << 32) | quotient_low;
     }
 
-    do {
-        if (remain >= scaled_divisor) {
-            remain -= scaled_divisor;
-            result += multiple;
-        }
+    // The quotient fits in 32 bits. It is estimated by dividing by the top 32 bits of the normalized
+    // divisor, which is at most one too large after the correction below (Hacker's Delight, 9-5).
+    unsigned shift = 31 - bit_scan_reverse(divisor_high);
+    uint32_t normalized = (uint32_t) ((divisor << shift) >> 32);
+    uint64_t halved = dividend >> 1;
+    uint32_t rem;
+    uint32_t estimate = udivmod64_32((uint32_t) (halved >> 32), (uint32_t) halved, normalized, &rem);
+
+    quotient = ((uint64_t) estimate << shift) >> 31;
+    if (quotient != 0) {
+        --quotient;
+    }
 
-        scaled_divisor >>= 1;
-        multiple >>= 1;
-    } while (multiple != 0);
+    uint64_t remain = dividend - quotient * divisor;
+    if (remain >= divisor) {
+        remain -= divisor;
+        ++quotient;
+    }
 
     if (remainder) {
         *remainder = remain;
     }
 
-    return result;
+    return quotient;
 }
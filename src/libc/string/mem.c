@@ -1,40 +1,142 @@
 #include <string.h>
 #include <stdint.h>
 
+#include "utility/bitops.h"
+
+// Below this number of bytes, aligning the destination and switching to word operations costs more than it
+// saves, so such operations are done one byte at a time.
+#define MEM_WORD_THRESHOLD (16U)
+
+// Words are accessed through these types, as the memory may hold objects of any type.
+typedef uint32_t __attribute__((may_alias)) mem_word;
+typedef uint32_t __attribute__((may_alias, aligned(1))) mem_unaligned_word;
+
+// The string instructions are used rather than loops. They are fast on every processor from the i486 on,
+// and the compiler cannot turn them back into calls to the functions they implement.
+
+static inline uint8_t* mem_stosb(uint8_t* dest, uint8_t value, size_t count) {
+    asm volatile("rep stosb" : "+D" (dest), "+c" (count) : "a" (value) : "memory");
+    return dest;
+}
+
+static inline uint8_t* mem_stosd(uint8_t* dest, uint32_t value, size_t words) {
+    asm volatile("rep stosl" : "+D" (dest), "+c" (words) : "a" (value) : "memory");
+    return dest;
+}
+
+// Copy `count` bytes forwards, and advance both pointers past the copied bytes.
+static inline void mem_movsb(uint8_t** dest, const uint8_t** src, size_t count) {
+    asm volatile("rep movsb" : "+D" (*dest), "+S" (*src), "+c" (count) : : "memory");
+}
+
+static inline void mem_movsd(uint8_t** dest, const uint8_t** src, size_t words) {
+    asm volatile("rep movsl" : "+D" (*dest), "+S" (*src), "+c" (words) : : "memory");
+}
+
+// Copy `count` bytes backwards, ending at (and excluding) the given pointers, and move both pointers back
+// past the copied bytes. The direction flag is cleared again afterwards, as the ABI requires.
+static inline void mem_movsb_backward(uint8_t** dest_end, const uint8_t** src_end, size_t count) {
+    uint8_t* dest = *dest_end - 1;
+    const uint8_t* src = *src_end - 1;
+    asm volatile("std\n\trep movsb\n\tcld" : "+D" (dest), "+S" (src), "+c" (count) : : "memory");
+    *dest_end = dest + 1;
+    *src_end = src + 1;
+}
+
+static inline void mem_movsd_backward(uint8_t** dest_end, const uint8_t** src_end, size_t words) {
+    uint8_t* dest = *dest_end - 4;
+    const uint8_t* src = *src_end - 4;
+    asm volatile("std\n\trep movsl\n\tcld" : "+D" (dest), "+S" (src), "+c" (words) : : "memory");
+    *dest_end = dest + 4;
+    *src_end = src + 4;
+}
+
 void* memset(void* dest, int ch, size_t count) {
-    for (size_t i = 0; i < count; ++i) {
-        ((uint8_t*) dest)[i] = ch;
+    uint8_t* bytes = dest;
+    uint8_t value = ch;
+
+    if (count >= MEM_WORD_THRESHOLD) {
+        size_t head = -(uintptr_t) bytes & 3;
+        bytes = mem_stosb(bytes, value, head);
+        count -= head;
+
+        bytes = mem_stosd(bytes, value * 0x01010101U, count >> 2);
+        count &= 3;
     }
 
+    mem_stosb(bytes, value, count);
     return dest;
 }
 
-void* memcpy(void* restrict dest, const void* restrict src, size_t count) {
-    for (size_t i = 0; i < count; ++i) {
-        ((uint8_t*) dest)[i] = ((uint8_t*) src)[i];
+// Copy forwards, aligning the destination for the word copies. This is also correct for overlapping ranges
+// if `dest` is below `src`, as every word is read before the bytes it overlaps are written.
+static void mem_copy_forward(uint8_t* dest, const uint8_t* src, size_t count) {
+    if (count >= MEM_WORD_THRESHOLD) {
+        size_t head = -(uintptr_t) dest & 3;
+        mem_movsb(&dest, &src, head);
+        count -= head;
+
+        mem_movsd(&dest, &src, count >> 2);
+        count &= 3;
     }
 
+    mem_movsb(&dest, &src, count);
+}
+
+void* memcpy(void* restrict dest, const void* restrict src, size_t count) {
+    mem_copy_forward(dest, src, count);
     return dest;
 }
 
 void* memmove(void* dest, const void* src, size_t count) {
-    if (dest < src) {
-        for (size_t i = 0; i < count; ++i) {
-            ((uint8_t*) dest)[i] = ((uint8_t*) src)[i];
-        }
-    } else if (dest > src) {
-        while (count > 0) {
-            --count;
-            ((uint8_t*) dest)[count] = ((uint8_t*) src)[count];
-        }
+    if (dest <= src || (const uint8_t*) src + count <= (uint8_t*) dest) {
+        mem_copy_forward(dest, src, count);
+        return dest;
     }
 
+    // The destination overlaps the end of the source, so copy backwards from the end. The end of the
+    // destination is aligned instead of the start.
+    uint8_t* dest_end = (uint8_t*) dest + count;
+    const uint8_t* src_end = (const uint8_t*) src + count;
+    if (count >= MEM_WORD_THRESHOLD) {
+        size_t tail = (uintptr_t) dest_end & 3;
+        mem_movsb_backward(&dest_end, &src_end, tail);
+        count -= tail;
+
+        mem_movsd_backward(&dest_end, &src_end, count >> 2);
+        count &= 3;
+    }
+
+    mem_movsb_backward(&dest_end, &src_end, count);
     return dest;
 }
 
+// Only the left-hand side is aligned: the right-hand side is read with unaligned words, which the processor
+// allows. Every word read lies within the ranges, so unlike the string functions this cannot fault.
 int memcmp(const void* lhs, const void* rhs, size_t count) {
     const uint8_t* lhs_bytes = lhs;
     const uint8_t* rhs_bytes = rhs;
+
+    while (count >= sizeof(mem_word) && ((uintptr_t) lhs_bytes & 3)) {
+        if (*lhs_bytes != *rhs_bytes)
+            return *lhs_bytes < *rhs_bytes ? -1 : 1;
+        ++lhs_bytes;
+        ++rhs_bytes;
+        --count;
+    }
+
+    while (count >= sizeof(mem_word)) {
+        uint32_t diff = *(const mem_word*) lhs_bytes ^ *(const mem_unaligned_word*) rhs_bytes;
+        if (diff) {
+            // The first differing byte in memory order is the least significant one.
+            size_t index = bit_scan_forward(diff) >> 3;
+            return lhs_bytes[index] < rhs_bytes[index] ? -1 : 1;
+        }
+        lhs_bytes += sizeof(mem_word);
+        rhs_bytes += sizeof(mem_word);
+        count -= sizeof(mem_word);
+    }
+
     for (size_t i = 0; i < count; ++i) {
         if (lhs_bytes[i] > rhs_bytes[i]) {
             return 1;
@@ -48,9 +150,28 @@ int memcmp(const void* lhs, const void* rhs, size_t count) {
 
 void* memchr(const void* ptr, int ch, size_t count) {
     const uint8_t* bytes = ptr;
+    uint8_t value = ch;
+
+    while (count > 0 && ((uintptr_t) bytes & 3)) {
+        if (*bytes == value)
+            return (void*) bytes; // cast away constness
+        ++bytes;
+        --count;
+    }
+
+    // Bytes equal to `value` become zero bytes after the exclusive or.
+    uint32_t pattern = byte_broadcast(value);
+    while (count >= sizeof(mem_word)) {
+        uint32_t mask = byte_zero_mask(*(const mem_word*) bytes ^ pattern);
+        if (mask)
+            return (void*) (bytes + (bit_scan_forward(mask) >> 3));
+        bytes += sizeof(mem_word);
+        count -= sizeof(mem_word);
+    }
+
     for (size_t i = 0; i < count; ++i) {
-        if (bytes[i] == ch) {
-            return (void*) &bytes[i]; // cast away constness
+        if (bytes[i] == value) {
+            return (void*) &bytes[i];
         }
     }
 
@@ -1,22 +1,82 @@
 #include <string.h>
+#include <stdint.h>
+
+#include "utility/bitops.h"
+
+// Strings are scanned a word at a time once the pointer is aligned. An aligned word never crosses a page
+// boundary, so reading the bytes after the terminator in the same word cannot fault.
+typedef uint32_t __attribute__((may_alias)) string_word;
+
+#define STRING_WORD_MASK (sizeof(string_word) - 1)
 
 size_t strlen(const char* str) {
-    size_t count = 0;
-    while(*str++) {
-        ++count;
+    const char* ptr = str;
+    while ((uintptr_t) ptr & STRING_WORD_MASK) {
+        if (!*ptr)
+            return ptr - str;
+        ++ptr;
     }
-    return count;
+
+    const string_word* word = (const string_word*) ptr;
+    uint32_t mask;
+    while (!(mask = byte_zero_mask(*word))) {
+        ++word;
+    }
+
+    return (const char*) word - str + (bit_scan_forward(mask) >> 3);
 }
 
+// Strings are compared a word at a time only if they have the same alignment, so that both can be read
+// with aligned words. The words are compared until they differ or contain the terminator, after which
+// the remaining bytes decide.
+
 int strcmp(const char* lhs, const char* rhs){
+    if (((uintptr_t) lhs & STRING_WORD_MASK) == ((uintptr_t) rhs & STRING_WORD_MASK)) {
+        while (((uintptr_t) lhs & STRING_WORD_MASK) && *lhs && *lhs == *rhs) {
+            ++lhs;
+            ++rhs;
+        }
+
+        if (!((uintptr_t) lhs & STRING_WORD_MASK)) {
+            const string_word* lhs_word = (const string_word*) lhs;
+            const string_word* rhs_word = (const string_word*) rhs;
+            while (*lhs_word == *rhs_word && !byte_zero_mask(*lhs_word)) {
+                ++lhs_word;
+                ++rhs_word;
+            }
+            lhs = (const char*) lhs_word;
+            rhs = (const char*) rhs_word;
+        }
+    }
+
     while(*lhs && (*lhs == *rhs)) {
         ++lhs;
         ++rhs;
     }
-    return *lhs - *rhs;
+    return (unsigned char) *lhs - (unsigned char) *rhs;
 }
 
 int strncmp(const char* lhs, const char* rhs, size_t count){
+    if (((uintptr_t) lhs & STRING_WORD_MASK) == ((uintptr_t) rhs & STRING_WORD_MASK)) {
+        while (count && ((uintptr_t) lhs & STRING_WORD_MASK) && *lhs && *lhs == *rhs) {
+            --count;
+            ++lhs;
+            ++rhs;
+        }
+
+        if (!((uintptr_t) lhs & STRING_WORD_MASK)) {
+            const string_word* lhs_word = (const string_word*) lhs;
+            const string_word* rhs_word = (const string_word*) rhs;
+            while (count >= sizeof(string_word) && *lhs_word == *rhs_word && !byte_zero_mask(*lhs_word)) {
+                count -= sizeof(string_word);
+                ++lhs_word;
+                ++rhs_word;
+            }
+            lhs = (const char*) lhs_word;
+            rhs = (const char*) rhs_word;
+        }
+    }
+
     while(count && *lhs && (*lhs == *rhs)) {
         --count;
         ++lhs;
@@ -24,5 +84,5 @@ int strncmp(const char* lhs, const char* rhs, size_t count){
     }
     if(count == 0)
         return 0;
-    return *lhs - *rhs;
+    return (unsigned char) *lhs - (unsigned char) *rhs;
 }
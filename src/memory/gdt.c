@@ -1,13 +1,18 @@
 #include "memory/gdt.h"
+#include "memory/page_table.h"
+
+#include "core/init.h"
+#include "core/cpu.h"
 
 extern void gdt_load(void*);
 extern void gdt_load_task_register(uint16_t segment);
 
 static struct gdt_descriptor descriptor;
-static struct gdt_entry entries[6];
+static struct gdt_entry entries[7];
 
-// TODO: Make sure this doesn't get placed over a page boundary
-static struct gdt_tss tss = {
+// The task state segments are aligned such that they do not cross a page boundary, which the processor
+// requires for task switches.
+static struct gdt_tss tss __attribute__((aligned(128))) = {
     .ss0 = 0x10,
     .esp0 = 0,
 
@@ -18,6 +23,22 @@ static struct gdt_tss tss = {
     .iomap_base = sizeof(struct gdt_tss), // disable bitmap
 };
 
+// Stack of the double fault task. This is separate from all kernel stacks, as the double fault may have been
+// caused by one of them overflowing.
+static uint8_t double_fault_stack[PAGE_SIZE] __attribute__((aligned(16)));
+
+// The remaining fields are filled in by `gdt_init` and `gdt_set_double_fault_task`.
+static struct gdt_tss double_fault_tss __attribute__((aligned(128))) = {
+    .cs = 0x08,
+    .ss = 0x10,
+    .ds = 0x10,
+    .es = 0x10,
+    .fs = 0x10,
+    .gs = 0x10,
+    .eflags = 0x2, // Reserved bit, interrupts disabled
+    .iomap_base = sizeof(struct gdt_tss),
+};
+
 void gdt_load_entry(struct gdt_entry* entry, uint32_t base, uint32_t limit, enum gdt_flags_type flags, enum gdt_access_type access) {
     entry->base_low = base & 0xFFFFu;
     entry->base_mid = (base & 0xFF0000u) >> 16u;
@@ -30,7 +51,7 @@ void gdt_load_entry(struct gdt_entry* entry, uint32_t base, uint32_t limit, enum
     entry->flags = flags;
 }
 
-void gdt_init(void) {
+__init void gdt_init(void) {
     //Selector 0, has to be 0
     gdt_load_entry(&entries[0], 0, 0, 0, 0);
 
@@ -74,14 +95,32 @@ void gdt_init(void) {
         GDT_ACCESS_PRESENT | GDT_ACCESS_PRIVILEGE_0 | GDT_ACCESS_EXECUTE | GDT_ACCESS_ACCESSED
     );
 
+    //Selector 0x30, double fault TSS segment
+    double_fault_tss.cr3 = cpu_read_cr3();
+    double_fault_tss.esp = (uintptr_t) double_fault_stack + sizeof(double_fault_stack);
+    gdt_load_entry(&entries[6],
+        (uint32_t) &double_fault_tss,
+        sizeof(struct gdt_tss),
+        0,
+        GDT_ACCESS_PRESENT | GDT_ACCESS_PRIVILEGE_0 | GDT_ACCESS_EXECUTE | GDT_ACCESS_ACCESSED
+    );
+
     descriptor.size = sizeof(entries) - 1;
     descriptor.addr = entries;
 
     gdt_load(&descriptor);
 
-    gdt_load_task_register(0x28);
+    gdt_load_task_register(GDT_KERNEL_TSS_SELECTOR);
 }
 
 void gdt_set_int_stack(void* new_stack) {
     tss.esp0 = (uintptr_t) new_stack;
 }
+
+void gdt_set_double_fault_task(void (*entry)(void)) {
+    double_fault_tss.eip = (uintptr_t) entry;
+}
+
+const struct gdt_tss* gdt_get_kernel_tss(void) {
+    return &tss;
+}
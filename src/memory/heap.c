@@ -0,0 +1,425 @@
+#include "memory/heap.h"
+#include "memory/pmm.h"
+#include "memory/vmm.h"
+#include "memory/align.h"
+#include "memory/page_table.h"
+#include "memory/kernel_layout.h"
+#include "memory/slab.h"
+#include "memory/memtag.h"
+
+#include "debug/assert.h"
+#include "debug/log.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// The minimum alignment of all allocations.
+#define HEAP_ALIGN (16U)
+
+// The smallest size class. Size classes are powers of two, up to `HEAP_MAX_SMALL_SIZE`.
+#define HEAP_MIN_SMALL_SIZE_LOG2 (4U)
+#define HEAP_MAX_SMALL_SIZE_LOG2 (10U)
+#define HEAP_SIZE_CLASSES (HEAP_MAX_SMALL_SIZE_LOG2 - HEAP_MIN_SMALL_SIZE_LOG2 + 1)
+_Static_assert(HEAP_MAX_SMALL_SIZE == 1U << HEAP_MAX_SMALL_SIZE_LOG2);
+
+// Every span of pages holding a large allocation starts with a header, which has this value in its
+// `magic` field. This is used to catch invalid frees.
+#define HEAP_MAGIC_LARGE (0x4C524745U)
+
+// The number of entries in a leaf of the small page map, and the number of leaves needed to cover the
+// heap area. Every leaf is a single page.
+#define HEAP_PAGE_MAP_LEAF_ENTRIES (PAGE_SIZE / sizeof(struct heap_small_page*))
+#define HEAP_PAGE_MAP_LEAVES ((KERNEL_HEAP_END - KERNEL_HEAP_START) / PAGE_SIZE / HEAP_PAGE_MAP_LEAF_ENTRIES)
+
+// Header of a page which is divided into blocks of a single size class. The header is kept outside of the
+// page, so that all of the page is available for blocks: with an inline header, a page of the largest
+// size class would only hold three blocks instead of four.
+struct heap_small_page {
+    // The page that is divided into blocks.
+    uint8_t* base;
+
+    // The size class of the blocks in this page.
+    uint16_t size_class;
+
+    // The number of blocks currently allocated from this page.
+    uint16_t used;
+
+    // Offset of the first block which was never handed out. Blocks are carved from the page lazily,
+    // so that a fresh page does not need to be walked to build its free list.
+    uint16_t unused_offset;
+
+    // The list of blocks which were freed.
+    void* free_list;
+
+    // Links in the list of pages of this size class which have free blocks.
+    struct heap_small_page* next;
+    struct heap_small_page* prev;
+};
+
+// Header of a span of pages which holds a single large allocation.
+struct __attribute__((aligned(HEAP_ALIGN))) heap_large_span {
+    uint32_t magic;
+
+    // The number of pages in this span, including the page that holds this header.
+    size_t pages;
+};
+
+// A span of pages in the heap area which is not in use. The structure is stored in the first page of the
+// span itself, which is the only page of the span that stays mapped.
+struct heap_free_span {
+    size_t pages;
+    struct heap_free_span* next;
+};
+
+static struct {
+    // The end of the part of the heap area which is currently in use.
+    uintptr_t heap_break;
+
+    // List of free spans below the heap break, ordered by address.
+    struct heap_free_span* free_spans;
+
+    // For every size class, the list of pages that have at least one free block.
+    struct heap_small_page* partial_pages[HEAP_SIZE_CLASSES];
+
+    // Cache from which the headers of small pages are allocated. It is created on the first small allocation.
+    struct kmem_cache* small_page_cache;
+
+    // The header of every small page, indexed by the page in the heap area. Leaves are allocated when
+    // a small page is first created in the part of the heap area they cover, and are never freed, as
+    // that takes at most one page per 4 MiB of heap area.
+    struct heap_small_page** small_page_map[HEAP_PAGE_MAP_LEAVES];
+} HEAP_STATE = {
+    .heap_break = KERNEL_HEAP_START,
+};
+
+// Unmap `pages` pages starting at `ptr`, and return them to the physical memory manager.
+static void heap_unmap_pages(void* ptr, size_t pages) {
+    if (pages == 0)
+        return;
+
+    for (size_t i = 0; i < pages; ++i) {
+        void* physical;
+        assert(vmm_translate((uint8_t*) ptr + i * PAGE_SIZE, &physical) == VMM_SUCCESS);
+        pmm_free(PAGE_INDEX((uintptr_t) physical));
+    }
+
+    assert(vmm_unmap_range(ptr, pages) == VMM_SUCCESS);
+    memtag_remove(MEMTAG_HEAP, pages);
+}
+
+// Map `pages` new pages starting at `ptr`.
+// Returns `false` if there was not enough memory, in which case nothing is mapped.
+static bool heap_map_pages(void* ptr, size_t pages) {
+    for (size_t i = 0; i < pages; ++i) {
+        void* virtual = (uint8_t*) ptr + i * PAGE_SIZE;
+        intptr_t page = pmm_alloc();
+        if (!PMM_ALLOC_FAILED(page) && vmm_map_page(virtual, (void*) (page << PAGE_OFFSET_BITS), VMM_MAP_WRITABLE) == VMM_SUCCESS) {
+            memtag_add(MEMTAG_HEAP, 1);
+            continue;
+        }
+
+        if (!PMM_ALLOC_FAILED(page))
+            pmm_free(page);
+
+        heap_unmap_pages(ptr, i);
+        return false;
+    }
+
+    return true;
+}
+
+// Allocate a span of `pages` mapped pages. Free spans are reused first-fit, and the heap is grown otherwise.
+// Returns NULL if there is not enough memory.
+static void* heap_alloc_span(size_t pages) {
+    struct heap_free_span** link = &HEAP_STATE.free_spans;
+    while (*link) {
+        struct heap_free_span* span = *link;
+        if (span->pages == pages) {
+            // The first page of a free span is still mapped.
+            if (!heap_map_pages((uint8_t*) span + PAGE_SIZE, pages - 1))
+                return NULL;
+
+            *link = span->next;
+            return span;
+        } else if (span->pages > pages) {
+            // Take the pages from the end of the span, so that the span structure can stay in place.
+            void* ptr = (uint8_t*) span + (span->pages - pages) * PAGE_SIZE;
+            if (!heap_map_pages(ptr, pages))
+                return NULL;
+
+            span->pages -= pages;
+            return ptr;
+        }
+
+        link = &span->next;
+    }
+
+    void* ptr = (void*) HEAP_STATE.heap_break;
+    if (pages > (KERNEL_HEAP_END - HEAP_STATE.heap_break) / PAGE_SIZE) {
+        log_warn("Kernel heap area exhausted");
+        return NULL;
+    }
+
+    if (!heap_map_pages(ptr, pages))
+        return NULL;
+
+    HEAP_STATE.heap_break += pages * PAGE_SIZE;
+    return ptr;
+}
+
+// Return a span of pages to the heap. Only the first page of a free span stays mapped, the memory of the
+// others is returned to the physical memory manager. The span is merged with adjacent free spans, and if
+// it borders the heap break, the break is lowered.
+static void heap_free_span(void* ptr, size_t pages) {
+    uintptr_t begin = (uintptr_t) ptr;
+    assert(IS_PAGE_ALIGNED(begin) && begin >= KERNEL_HEAP_START && begin + pages * PAGE_SIZE <= HEAP_STATE.heap_break);
+
+    heap_unmap_pages((uint8_t*) ptr + PAGE_SIZE, pages - 1);
+
+    // Find the position in the list, and keep track of the link to the previous span in case it has to be merged.
+    struct heap_free_span** prev_link = NULL;
+    struct heap_free_span** link = &HEAP_STATE.free_spans;
+    while (*link && (uintptr_t) *link < begin) {
+        prev_link = link;
+        link = &(*link)->next;
+    }
+
+    struct heap_free_span* span = ptr;
+    span->pages = pages;
+    span->next = *link;
+    *link = span;
+
+    struct heap_free_span* next = span->next;
+    if (next && begin + span->pages * PAGE_SIZE == (uintptr_t) next) {
+        span->pages += next->pages;
+        span->next = next->next;
+        heap_unmap_pages(next, 1);
+    }
+
+    struct heap_free_span* prev = prev_link ? *prev_link : NULL;
+    if (prev && (uintptr_t) prev + prev->pages * PAGE_SIZE == begin) {
+        prev->pages += span->pages;
+        prev->next = span->next;
+        heap_unmap_pages(span, 1);
+        span = prev;
+        link = prev_link;
+    }
+
+    // Only the last free span can border the heap break.
+    if (!span->next && (uintptr_t) span + span->pages * PAGE_SIZE == HEAP_STATE.heap_break) {
+        *link = NULL;
+        HEAP_STATE.heap_break = (uintptr_t) span;
+        heap_unmap_pages(span, 1);
+    }
+}
+
+// Return the size class for an allocation size.
+static unsigned heap_size_class(size_t size) {
+    unsigned size_class = 0;
+    while ((1U << (size_class + HEAP_MIN_SMALL_SIZE_LOG2)) < size)
+        ++size_class;
+    return size_class;
+}
+
+static void heap_partial_push(struct heap_small_page* page) {
+    struct heap_small_page* head = HEAP_STATE.partial_pages[page->size_class];
+    page->prev = NULL;
+    page->next = head;
+    if (head)
+        head->prev = page;
+    HEAP_STATE.partial_pages[page->size_class] = page;
+}
+
+static void heap_partial_remove(struct heap_small_page* page) {
+    if (page->prev) {
+        page->prev->next = page->next;
+    } else {
+        HEAP_STATE.partial_pages[page->size_class] = page->next;
+    }
+
+    if (page->next)
+        page->next->prev = page->prev;
+}
+
+// Return the entry of the small page map for the heap page at `ptr`. If `create` is set, the leaf holding
+// the entry is allocated if necessary.
+// Returns NULL if the leaf does not exist and could not be allocated or `create` is not set.
+static struct heap_small_page** heap_small_page_slot(void* ptr, bool create) {
+    size_t index = PAGE_INDEX((uintptr_t) ptr - KERNEL_HEAP_START);
+    struct heap_small_page*** leaf = &HEAP_STATE.small_page_map[index / HEAP_PAGE_MAP_LEAF_ENTRIES];
+    if (!*leaf) {
+        if (!create)
+            return NULL;
+
+        *leaf = heap_alloc_span(1);
+        if (!*leaf)
+            return NULL;
+        memset(*leaf, 0, PAGE_SIZE);
+    }
+
+    return &(*leaf)[index % HEAP_PAGE_MAP_LEAF_ENTRIES];
+}
+
+// Return the header of the small page containing `ptr`, or NULL if it is not part of a small page.
+static struct heap_small_page* heap_small_page_find(void* ptr) {
+    struct heap_small_page** slot = heap_small_page_slot(ptr, false);
+    return slot ? *slot : NULL;
+}
+
+// Allocate a page for blocks of `size_class`, together with its header.
+// Returns NULL if there is not enough memory.
+static struct heap_small_page* heap_small_page_create(unsigned size_class) {
+    if (!HEAP_STATE.small_page_cache) {
+        HEAP_STATE.small_page_cache = kmem_cache_create("heap_page", sizeof(struct heap_small_page), 0, NULL);
+        if (!HEAP_STATE.small_page_cache)
+            return NULL;
+    }
+
+    struct heap_small_page* page = kmem_cache_alloc(HEAP_STATE.small_page_cache);
+    if (!page)
+        return NULL;
+
+    void* base = heap_alloc_span(1);
+    struct heap_small_page** slot = base ? heap_small_page_slot(base, true) : NULL;
+    if (!slot) {
+        if (base)
+            heap_free_span(base, 1);
+        kmem_cache_free(HEAP_STATE.small_page_cache, page);
+        return NULL;
+    }
+
+    *page = (struct heap_small_page){
+        .base = base,
+        .size_class = size_class,
+        .used = 0,
+        .unused_offset = 0,
+        .free_list = NULL,
+    };
+    *slot = page;
+    return page;
+}
+
+static void heap_small_page_destroy(struct heap_small_page* page) {
+    *heap_small_page_slot(page->base, false) = NULL;
+    heap_free_span(page->base, 1);
+    kmem_cache_free(HEAP_STATE.small_page_cache, page);
+}
+
+static void* heap_alloc_small(size_t size) {
+    unsigned size_class = heap_size_class(size);
+    size_t block_size = 1U << (size_class + HEAP_MIN_SMALL_SIZE_LOG2);
+
+    struct heap_small_page* page = HEAP_STATE.partial_pages[size_class];
+    if (!page) {
+        page = heap_small_page_create(size_class);
+        if (!page)
+            return NULL;
+
+        heap_partial_push(page);
+    }
+
+    void* block;
+    if (page->free_list) {
+        block = page->free_list;
+        page->free_list = *(void**) block;
+    } else {
+        block = page->base + page->unused_offset;
+        page->unused_offset += block_size;
+    }
+
+    ++page->used;
+
+    // Remove the page from the partial list if this was the last free block.
+    if (!page->free_list && page->unused_offset + block_size > PAGE_SIZE)
+        heap_partial_remove(page);
+
+    return block;
+}
+
+static void heap_free_small(struct heap_small_page* page, void* ptr) {
+    size_t block_size = 1U << (page->size_class + HEAP_MIN_SMALL_SIZE_LOG2);
+    assert(IS_ALIGNED_TO((uintptr_t) ptr - (uintptr_t) page->base, block_size));
+    assert(page->used > 0);
+
+    bool was_full = !page->free_list && page->unused_offset + block_size > PAGE_SIZE;
+
+    *(void**) ptr = page->free_list;
+    page->free_list = ptr;
+    --page->used;
+
+    if (was_full)
+        heap_partial_push(page);
+
+    // Give empty pages back, unless it is the only page of the size class with free blocks left. This
+    // avoids repeatedly mapping and unmapping a page when a single block is allocated and freed.
+    if (page->used == 0 && (page->prev || page->next)) {
+        heap_partial_remove(page);
+        heap_small_page_destroy(page);
+    }
+}
+
+static void* heap_alloc(size_t size) {
+    if (size <= HEAP_MAX_SMALL_SIZE)
+        return heap_alloc_small(size);
+
+    if (size > KERNEL_HEAP_END - KERNEL_HEAP_START)
+        return NULL;
+
+    size_t pages = PAGE_INDEX(PAGE_ALIGN_FORWARD(size + sizeof(struct heap_large_span)));
+    struct heap_large_span* span = heap_alloc_span(pages);
+    if (!span)
+        return NULL;
+
+    span->magic = HEAP_MAGIC_LARGE;
+    span->pages = pages;
+    return span + 1;
+}
+
+void* kmalloc(size_t size) {
+    if (size == 0)
+        return NULL;
+
+    void* ptr = heap_alloc(size);
+
+    // Empty slabs and pre-zeroed pages are cached. Release them and try again before giving up.
+    if (!ptr && kmem_reclaim() + pmm_zero_drain() > 0)
+        ptr = heap_alloc(size);
+
+    return ptr;
+}
+
+void kfree(void* ptr) {
+    if (!ptr)
+        return;
+
+    assert((uintptr_t) ptr >= KERNEL_HEAP_START && (uintptr_t) ptr < HEAP_STATE.heap_break);
+
+    // Small pages are found through the small page map, large allocations have their header at the
+    // start of the page.
+    void* page = (void*) PAGE_ALIGN_BACKWARD((uintptr_t) ptr);
+    struct heap_small_page* small_page = heap_small_page_find(page);
+    if (small_page) {
+        heap_free_small(small_page, ptr);
+    } else if (*(uint32_t*) page == HEAP_MAGIC_LARGE) {
+        struct heap_large_span* span = page;
+        assert(ptr == span + 1);
+        span->magic = 0;
+        heap_free_span(span, span->pages);
+    } else {
+        log_error("kfree: %p was not allocated by kmalloc", ptr);
+        unreachable();
+    }
+}
+
+void* heap_alloc_pages(size_t pages) {
+    if (pages == 0 || pages > (KERNEL_HEAP_END - KERNEL_HEAP_START) / PAGE_SIZE)
+        return NULL;
+
+    return heap_alloc_span(pages);
+}
+
+void heap_free_pages(void* ptr, size_t pages) {
+    assert(pages > 0);
+    heap_free_span(ptr, pages);
+}
@@ -0,0 +1,103 @@
+#include "memory/kstack.h"
+#include "memory/vaddr.h"
+#include "memory/pmm.h"
+#include "memory/vmm.h"
+#include "memory/page_table.h"
+#include "memory/memtag.h"
+
+#include "debug/assert.h"
+
+#include <stdbool.h>
+
+struct kstack {
+    // The start of the guard pages, which is also the start of the address space reserved for the stack.
+    uintptr_t base;
+
+    // The number of mapped pages above the guard pages, or 0 if this entry is not used.
+    size_t pages;
+};
+
+static struct kstack KSTACKS[KSTACK_MAX];
+
+static uintptr_t kstack_top(const struct kstack* stack) {
+    return stack->base + (KSTACK_GUARD_PAGES + stack->pages) * PAGE_SIZE;
+}
+
+// Unmap and free the first `pages` pages of the stack at `stack`, which starts after the guard pages.
+static void kstack_release_pages(uint8_t* stack, size_t pages) {
+    for (size_t i = 0; i < pages; ++i) {
+        void* physical;
+        assert(vmm_translate(stack + i * PAGE_SIZE, &physical) == VMM_SUCCESS);
+        pmm_free(PAGE_INDEX((uintptr_t) physical));
+    }
+
+    vmm_unmap_range(stack, pages);
+}
+
+void* kstack_alloc(size_t pages) {
+    assert(pages > 0);
+
+    struct kstack* entry = NULL;
+    for (size_t i = 0; i < KSTACK_MAX && !entry; ++i) {
+        if (KSTACKS[i].pages == 0)
+            entry = &KSTACKS[i];
+    }
+
+    if (!entry)
+        return NULL;
+
+    size_t size = (KSTACK_GUARD_PAGES + pages) * PAGE_SIZE;
+    uint8_t* base = vaddr_alloc(size);
+    if (!base)
+        return NULL;
+
+    // The guard pages are reserved in the address space, but never mapped.
+    uint8_t* stack = base + KSTACK_GUARD_PAGES * PAGE_SIZE;
+    for (size_t i = 0; i < pages; ++i) {
+        intptr_t page = pmm_alloc();
+        if (PMM_ALLOC_FAILED(page)) {
+            kstack_release_pages(stack, i);
+            vaddr_free(base, size);
+            return NULL;
+        }
+
+        if (vmm_map_page(stack + i * PAGE_SIZE, (void*) (page << PAGE_OFFSET_BITS), VMM_MAP_WRITABLE) != VMM_SUCCESS) {
+            pmm_free(page);
+            kstack_release_pages(stack, i);
+            vaddr_free(base, size);
+            return NULL;
+        }
+    }
+
+    entry->base = (uintptr_t) base;
+    entry->pages = pages;
+    memtag_add(MEMTAG_STACK, pages);
+    return (void*) kstack_top(entry);
+}
+
+void kstack_free(void* top) {
+    for (size_t i = 0; i < KSTACK_MAX; ++i) {
+        struct kstack* entry = &KSTACKS[i];
+        if (entry->pages == 0 || kstack_top(entry) != (uintptr_t) top)
+            continue;
+
+        kstack_release_pages((uint8_t*) entry->base + KSTACK_GUARD_PAGES * PAGE_SIZE, entry->pages);
+        vaddr_free((void*) entry->base, (KSTACK_GUARD_PAGES + entry->pages) * PAGE_SIZE);
+        memtag_remove(MEMTAG_STACK, entry->pages);
+        entry->pages = 0;
+        return;
+    }
+
+    // Not a stack allocated by `kstack_alloc`.
+    unreachable();
+}
+
+void* kstack_find_guard(uintptr_t address) {
+    for (size_t i = 0; i < KSTACK_MAX; ++i) {
+        const struct kstack* entry = &KSTACKS[i];
+        if (entry->pages > 0 && address >= entry->base && address - entry->base < KSTACK_GUARD_PAGES * PAGE_SIZE)
+            return (void*) kstack_top(entry);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,79 @@
+#include "memory/memtag.h"
+#include "memory/pmm.h"
+#include "memory/page_table.h"
+
+#include "debug/assert.h"
+#include "debug/console/console.h"
+
+#include <string.h>
+
+const char* MEMTAG_NAMES[] = {
+    [MEMTAG_KERNEL_IMAGE] = "kernel image",
+    [MEMTAG_PMM] = "pmm metadata",
+    [MEMTAG_PAGE_TABLE] = "page tables",
+    [MEMTAG_HEAP] = "heap",
+    [MEMTAG_SLAB] = "slab",
+    [MEMTAG_ZERO_POOL] = "zero pool",
+    [MEMTAG_REGION] = "regions",
+    [MEMTAG_STACK] = "stacks",
+    [MEMTAG_BOOT_MODULE] = "boot modules",
+};
+
+_Static_assert(sizeof(MEMTAG_NAMES) / sizeof(MEMTAG_NAMES[0]) == MEMTAG_COUNT);
+
+static struct {
+    struct memtag_stats tags[MEMTAG_COUNT];
+
+    // The sum of all tags, and its peak. This is not the sum of the peaks of the tags, as those
+    // need not have happened at the same time.
+    struct memtag_stats total;
+} MEMTAG_STATE;
+
+static void memtag_stats_add(struct memtag_stats* stats, size_t pages) {
+    stats->pages += pages;
+    if (stats->pages > stats->peak_pages)
+        stats->peak_pages = stats->pages;
+}
+
+void memtag_add(enum memtag tag, size_t pages) {
+    assert(tag < MEMTAG_COUNT);
+    memtag_stats_add(&MEMTAG_STATE.tags[tag], pages);
+    memtag_stats_add(&MEMTAG_STATE.total, pages);
+}
+
+void memtag_remove(enum memtag tag, size_t pages) {
+    assert(tag < MEMTAG_COUNT);
+    assert(MEMTAG_STATE.tags[tag].pages >= pages);
+    MEMTAG_STATE.tags[tag].pages -= pages;
+    MEMTAG_STATE.total.pages -= pages;
+}
+
+void memtag_get_stats(enum memtag tag, struct memtag_stats* stats) {
+    assert(tag < MEMTAG_COUNT);
+    *stats = MEMTAG_STATE.tags[tag];
+}
+
+static void memtag_print_line(const char* name, const struct memtag_stats* stats) {
+    console_print(name);
+    for (size_t i = strlen(name); i < 16; ++i)
+        console_putchar(' ');
+
+    // Sizes are printed in KiB, 4 per page.
+    console_printf("%8zu %8zu\n", stats->pages * (PAGE_SIZE / 1024), stats->peak_pages * (PAGE_SIZE / 1024));
+}
+
+void memtag_print_stats(void) {
+    console_print("tag              now KiB peak KiB\n");
+    for (size_t i = 0; i < MEMTAG_COUNT; ++i)
+        memtag_print_line(MEMTAG_NAMES[i], &MEMTAG_STATE.tags[i]);
+    memtag_print_line("total", &MEMTAG_STATE.total);
+
+    size_t free_pages = pmm_free_pages();
+    console_printf("free: %zu KiB of %zu KiB\n", free_pages * (PAGE_SIZE / 1024), pmm_total_pages() * (PAGE_SIZE / 1024));
+
+    // The fragmentation is the percentage of free memory which cannot be used for the largest possible allocation.
+    if (free_pages > 0) {
+        size_t largest = pmm_largest_free_run();
+        console_printf("largest free run: %zu KiB, fragmentation: %zu%%\n", largest * (PAGE_SIZE / 1024), 100 - largest * 100 / free_pages);
+    }
+}
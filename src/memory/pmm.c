@@ -3,10 +3,13 @@
 #include "memory/align.h"
 #include "memory/page_table.h"
 #include "memory/kernel_layout.h"
+#include "memory/memtag.h"
+#include "core/init.h"
 
 #include "debug/assert.h"
 #include "debug/log.h"
 #include "core/panic.h"
+#include "utility/bitops.h"
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -27,6 +30,17 @@ _Static_assert(CHAR_BIT == 8);
 // The absolute maximum number of pages that the bitmap can be on a 32-bit system.
 #define MAX_BITMAP_PAGES (MAX_PAGES / BITS_PER_PAGE)
 
+// The bitmap is scanned one word at a time. This is the number of pages tracked by a single word.
+#define BITS_PER_WORD (sizeof(uint32_t) * CHAR_BIT)
+#define BITS_PER_WORD_LOG2 (5)
+_Static_assert(BITS_PER_WORD == 1U << BITS_PER_WORD_LOG2);
+
+// The maximum number of words in the bitmap.
+#define MAX_BITMAP_WORDS (MAX_PAGES / BITS_PER_WORD)
+
+// A word in the bitmap which has all its pages allocated.
+#define WORD_ALL_ALLOCATED (~(uint32_t) 0)
+
 static struct {
     // The total amount of pages the system has to keep track of.
     // Physical pages are assumed to exist for addresses 0 < x < `pages`.
@@ -34,6 +48,10 @@ static struct {
     // here.
     size_t total_pages;
 
+    // The number of words of the bitmap that are in use, which is `total_pages` rounded up
+    // to a whole number of words.
+    size_t total_words;
+
     // The total amount of pages currently available for allocation.
     size_t free_pages;
 
@@ -42,10 +60,18 @@ static struct {
     // of the bitmap.
     size_t scan_index;
 
+    // An upper bound of the number of pages in the largest contiguous run of free pages, or `SIZE_MAX`
+    // if this is not known. Allocating pages never invalidates this bound, but freeing pages does.
+    // This allows contiguous allocations which can never succeed to fail without scanning the bitmap.
+    size_t largest_free_run;
+
     // Number of elements currently in the page stack.
     size_t page_stack_top;
 
-    // Stack used to quickly find new pages.
+    // Stack used to quickly find new pages. Pages on the stack are free, and counted in `free_pages`, but
+    // marked as allocated in the bitmap. This way allocating and freeing a page only touches the stack,
+    // and the contiguous allocator never sees them. Which pages are on the stack is tracked in
+    // `PAGE_STACK_BITMAP`.
     uintptr_t page_stack[PMM_PAGE_STACK_ENTRIES];
 } PMM_STATE;
 
@@ -55,12 +81,24 @@ static struct {
 // at least a few hundred KB of memory to boot. Memory which isn't used is marked as free
 // after the physical memory allocator is started.
 // This buffer is page aligned to make freeing the unused memory more efficient.
-uint8_t BITMAP[MAX_BITMAP_PAGES * PAGE_SIZE] __attribute__((aligned(PAGE_SIZE)));
+// Bits which lie beyond `total_pages` in the last word in use are always marked as allocated.
+uint32_t BITMAP[MAX_BITMAP_PAGES * PAGE_SIZE / sizeof(uint32_t)] __attribute__((aligned(PAGE_SIZE)));
+
+// A summary of the bitmap: a bit in here is set if the corresponding word of `BITMAP` has at
+// least one free page. This allows the free page search to skip over 1024 allocated pages
+// at once, so that the time it takes to find a page does not depend on the amount of memory
+// that is already allocated.
+static uint32_t BITMAP_SUMMARY[MAX_BITMAP_WORDS / BITS_PER_WORD];
+
+// A second bitmap, in which the bit of a page is set while it is on the page stack. Without it, a page that
+// is freed twice would look allocated the second time, and end up on the stack twice. The unused part is
+// released like that of `BITMAP`.
+static uint32_t PAGE_STACK_BITMAP[MAX_BITMAP_PAGES * PAGE_SIZE / sizeof(uint32_t)] __attribute__((aligned(PAGE_SIZE)));
 
 // Compute the total number of pages that the system has to keep track of.
 // This entails the number of pages from physical address 0 to the physical page
 // with the largest address.
-static size_t compute_total_pages(const struct multiboot* mb) {
+__init static size_t compute_total_pages(const struct multiboot* mb) {
     uint64_t max_addr = 0;
 
     uintptr_t entry_addr = (uintptr_t) mb->mmap_addr;
@@ -86,31 +124,227 @@ static size_t compute_total_pages(const struct multiboot* mb) {
     return (size_t) (max_addr >> PAGE_OFFSET_BITS); // Round down to a number of pages.
 }
 
+// Update the summary bit of a particular word in the bitmap.
+static void bitmap_update_summary(size_t word_index) {
+    uint32_t mask = 1U << (word_index % BITS_PER_WORD);
+    if (BITMAP[word_index] == WORD_ALL_ALLOCATED) {
+        BITMAP_SUMMARY[word_index / BITS_PER_WORD] &= ~mask;
+    } else {
+        BITMAP_SUMMARY[word_index / BITS_PER_WORD] |= mask;
+    }
+}
+
 // Set the state of a particular page in the bitmap
 static void bitmap_set_allocated(uintptr_t page, bool allocated) {
     assert(page < PMM_STATE.total_pages);
+    size_t word_index = page / BITS_PER_WORD;
     if (allocated) {
-        BITMAP[page / CHAR_BIT] |= 1 << (page % CHAR_BIT);
+        BITMAP[word_index] |= 1U << (page % BITS_PER_WORD);
     } else {
-        BITMAP[page / CHAR_BIT] &= ~(1 << (page % CHAR_BIT));
+        BITMAP[word_index] &= ~(1U << (page % BITS_PER_WORD));
     }
+    bitmap_update_summary(word_index);
 }
 
 // Check whether a particular page in the bitmap is allocated.
 static bool bitmap_is_allocated(uintptr_t page) {
     assert(page < PMM_STATE.total_pages);
-    return (BITMAP[page / CHAR_BIT] >> (page % CHAR_BIT)) & 1;
+    return (BITMAP[page / BITS_PER_WORD] >> (page % BITS_PER_WORD)) & 1;
+}
+
+// Record whether a particular page is on the page stack.
+static void page_stack_set_contains(uintptr_t page, bool contains) {
+    uint32_t mask = 1U << (page % BITS_PER_WORD);
+    if (contains) {
+        PAGE_STACK_BITMAP[page / BITS_PER_WORD] |= mask;
+    } else {
+        PAGE_STACK_BITMAP[page / BITS_PER_WORD] &= ~mask;
+    }
+}
+
+// Check whether a particular page is on the page stack.
+static bool page_stack_contains(uintptr_t page) {
+    assert(page < PMM_STATE.total_pages);
+    return (PAGE_STACK_BITMAP[page / BITS_PER_WORD] >> (page % BITS_PER_WORD)) & 1;
+}
+
+// Find the first free page in the range [begin, end).
+// Words without any free pages are skipped using the summary bitmap.
+// Returns `end` if there is no free page in the range.
+static uintptr_t bitmap_find_free(uintptr_t begin, uintptr_t end) {
+    assert(begin <= end && end <= PMM_STATE.total_pages);
+    if (begin == end)
+        return end;
+
+    size_t word_index = begin / BITS_PER_WORD;
+    uint32_t free_bits = ~BITMAP[word_index] & (WORD_ALL_ALLOCATED << (begin % BITS_PER_WORD));
+
+    if (free_bits == 0) {
+        // Nothing in the first (partial) word, consult the summary for the next word which has a free page.
+        size_t end_word = (end + BITS_PER_WORD - 1) / BITS_PER_WORD;
+        ++word_index;
+        if (word_index >= end_word)
+            return end;
+
+        size_t summary_index = word_index / BITS_PER_WORD;
+        uint32_t summary_bits = BITMAP_SUMMARY[summary_index] & (WORD_ALL_ALLOCATED << (word_index % BITS_PER_WORD));
+        while (summary_bits == 0) {
+            ++summary_index;
+            if (summary_index * BITS_PER_WORD >= end_word)
+                return end;
+            summary_bits = BITMAP_SUMMARY[summary_index];
+        }
+
+        word_index = summary_index * BITS_PER_WORD + bit_scan_forward(summary_bits);
+        if (word_index >= end_word)
+            return end;
+
+        free_bits = ~BITMAP[word_index];
+        assert(free_bits != 0); // If this is reached, the summary is out of sync with the bitmap.
+    }
+
+    uintptr_t page = word_index * BITS_PER_WORD + bit_scan_forward(free_bits);
+    return page < end ? page : end;
+}
+
+// Find the first allocated page in the range [begin, end).
+// Returns `end` if all pages in the range are free.
+static uintptr_t bitmap_find_allocated(uintptr_t begin, uintptr_t end) {
+    assert(begin <= end && end <= PMM_STATE.total_pages);
+    if (begin == end)
+        return end;
+
+    size_t word_index = begin / BITS_PER_WORD;
+    size_t end_word = (end + BITS_PER_WORD - 1) / BITS_PER_WORD;
+    uint32_t allocated_bits = BITMAP[word_index] & (WORD_ALL_ALLOCATED << (begin % BITS_PER_WORD));
+
+    while (allocated_bits == 0) {
+        ++word_index;
+        if (word_index >= end_word)
+            return end;
+        allocated_bits = BITMAP[word_index];
+    }
+
+    uintptr_t page = word_index * BITS_PER_WORD + bit_scan_forward(allocated_bits);
+    return page < end ? page : end;
+}
+
+// Find a run of `count` free pages, of which the first page is a multiple of `align`.
+// Runs of free pages are found by alternately searching for the next free and the next allocated page,
+// both of which skip over entire words at once.
+// Returns the first page of the run, or a negative value if there is no such run. In the latter case
+// the size of the largest run of free pages is written to `largest_run`.
+static intptr_t bitmap_find_run(size_t count, size_t align, size_t* largest_run) {
+    uintptr_t total = PMM_STATE.total_pages;
+    size_t largest = 0;
+
+    uintptr_t page = 0;
+    while (page < total) {
+        uintptr_t run_begin = bitmap_find_free(page, total);
+        if (run_begin == total)
+            break;
+
+        // Only scan for as many pages as required, so that allocating from a large run stays cheap.
+        // If the run turns out to be too short, its end is found exactly.
+        uintptr_t candidate = ALIGN_FORWARD_2POW(run_begin, align);
+        uintptr_t limit = candidate < total && total - candidate > count ? candidate + count : total;
+        uintptr_t run_end = bitmap_find_allocated(run_begin, limit);
+
+        if (candidate < run_end && run_end - candidate >= count)
+            return candidate;
+
+        if (run_end - run_begin > largest)
+            largest = run_end - run_begin;
+
+        page = run_end;
+    }
+
+    *largest_run = largest;
+    return -1;
+}
+
+// Return the mask of bits in a word that lie in the range [begin, end), relative to the start of the word.
+// `begin` must be smaller than `end`, and `end` may be at most `BITS_PER_WORD`.
+static uint32_t word_range_mask(size_t begin, size_t end) {
+    uint32_t mask = WORD_ALL_ALLOCATED << begin;
+    if (end < BITS_PER_WORD)
+        mask &= ~(WORD_ALL_ALLOCATED << end);
+    return mask;
+}
+
+// Set or clear all bits in the range [begin, end) of an array of words. The partial words at the start
+// and end of the range are masked, and the whole bytes in between are filled using `memset`.
+static void words_fill_bits(uint32_t* words, size_t begin, size_t end, bool set) {
+    if (begin == end)
+        return;
+
+    size_t begin_word = begin / BITS_PER_WORD;
+    size_t last_word = (end - 1) / BITS_PER_WORD;
+
+    if (begin_word == last_word) {
+        uint32_t mask = word_range_mask(begin % BITS_PER_WORD, end - begin_word * BITS_PER_WORD);
+        words[begin_word] = set ? words[begin_word] | mask : words[begin_word] & ~mask;
+        return;
+    }
+
+    uint32_t head_mask = word_range_mask(begin % BITS_PER_WORD, BITS_PER_WORD);
+    words[begin_word] = set ? words[begin_word] | head_mask : words[begin_word] & ~head_mask;
+
+    uint32_t tail_mask = word_range_mask(0, end - last_word * BITS_PER_WORD);
+    words[last_word] = set ? words[last_word] | tail_mask : words[last_word] & ~tail_mask;
+
+    size_t middle_words = last_word - begin_word - 1;
+    memset(&words[begin_word + 1], set ? 0xFF : 0x00, middle_words * sizeof(uint32_t));
+}
+
+// Count the number of set bits in the range [begin, end) of an array of words.
+static size_t words_count_bits(const uint32_t* words, size_t begin, size_t end) {
+    if (begin == end)
+        return 0;
+
+    size_t begin_word = begin / BITS_PER_WORD;
+    size_t last_word = (end - 1) / BITS_PER_WORD;
+
+    if (begin_word == last_word)
+        return bit_count(words[begin_word] & word_range_mask(begin % BITS_PER_WORD, end - begin_word * BITS_PER_WORD));
+
+    size_t count = bit_count(words[begin_word] & word_range_mask(begin % BITS_PER_WORD, BITS_PER_WORD));
+    count += bit_count(words[last_word] & word_range_mask(0, end - last_word * BITS_PER_WORD));
+
+    for (size_t i = begin_word + 1; i < last_word; ++i) {
+        // Regions are usually either entirely allocated or entirely free, so avoid counting in those cases.
+        uint32_t word = words[i];
+        if (word == WORD_ALL_ALLOCATED)
+            count += BITS_PER_WORD;
+        else if (word != 0)
+            count += bit_count(word);
+    }
+
+    return count;
 }
 
 // Set a region of pages as allocated or free.
 // begin is inclusive, end is exclusive.
-// TODO: Optimize
-static void bitmap_mark_pages(uintptr_t begin, uintptr_t end , bool mark_as_allocated) {
+// Returns the number of pages of which the state was changed.
+static size_t bitmap_mark_pages(uintptr_t begin, uintptr_t end, bool mark_as_allocated) {
     assert(begin <= end && end <= PMM_STATE.total_pages);
-
-    for (uintptr_t page = begin; page < end; ++page) {
-        bitmap_set_allocated(page, mark_as_allocated);
+    if (begin == end)
+        return 0;
+
+    size_t allocated = words_count_bits(BITMAP, begin, end);
+    words_fill_bits(BITMAP, begin, end, mark_as_allocated);
+
+    // Words which are entirely inside the range are now all free or all allocated. The first and
+    // last word may contain pages outside of the range, so check those explicitly.
+    size_t begin_word = begin / BITS_PER_WORD;
+    size_t last_word = (end - 1) / BITS_PER_WORD;
+    bitmap_update_summary(begin_word);
+    bitmap_update_summary(last_word);
+    if (last_word - begin_word > 1) {
+        words_fill_bits(BITMAP_SUMMARY, begin_word + 1, last_word, !mark_as_allocated);
     }
+
+    return mark_as_allocated ? (end - begin) - allocated : allocated;
 }
 
 // Compute the initial state of the bitmap.
@@ -119,12 +353,14 @@ static void bitmap_mark_pages(uintptr_t begin, uintptr_t end , bool mark_as_allo
 // as available memory, and pages which are used to host the kernel itself.
 // This function also frees parts of the bitmap which are unused.
 // Returns the total number of free pages.
-static size_t bitmap_init(const struct multiboot* mb, size_t pages, size_t bitmap_pages) {
+__init static size_t bitmap_init(const struct multiboot* mb, size_t pages, size_t bitmap_pages) {
     size_t free_pages = 0;
 
     // Mark the entire bitmap as allocated. Just handle this in page granularity, as
-    // the size of the bitmap is rounded anyway.
+    // the size of the bitmap is rounded anyway. This also means that no word has any free pages.
     memset(BITMAP, 0xFF, bitmap_pages * PAGE_SIZE);
+    memset(BITMAP_SUMMARY, 0, sizeof(BITMAP_SUMMARY));
+    memset(PAGE_STACK_BITMAP, 0, bitmap_pages * PAGE_SIZE);
 
     // Mark multiboot available memory as free
     uintptr_t entry_addr = (uintptr_t) mb->mmap_addr;
@@ -145,8 +381,7 @@ static size_t bitmap_init(const struct multiboot* mb, size_t pages, size_t bitma
                 if (end_page > MAX_PAGES)
                     end_page = MAX_PAGES;
 
-                bitmap_mark_pages((uintptr_t) begin_page, (uintptr_t) end_page, false);
-                free_pages += (size_t) (end_page - begin_page);
+                free_pages += bitmap_mark_pages((uintptr_t) begin_page, (uintptr_t) end_page, false);
             }
         }
 
@@ -156,67 +391,37 @@ static size_t bitmap_init(const struct multiboot* mb, size_t pages, size_t bitma
     // Mark the kernel area as allocated.
     uintptr_t kernel_begin_page = PAGE_INDEX(KERNEL_PHYSICAL_START);
     uintptr_t kernel_end_page = PAGE_INDEX(PAGE_ALIGN_FORWARD(KERNEL_PHYSICAL_END));
-    bitmap_mark_pages(kernel_begin_page, kernel_end_page, true);
-    free_pages -= (size_t) (kernel_end_page - kernel_begin_page);
-
-    // Mark the unused part of the bitmap as free.
-    uintptr_t bitmap_physical_start = (uintptr_t) KERNEL_VIRTUAL_TO_PHYSICAL(BITMAP);
-    uintptr_t bitmap_free_begin_page = PAGE_INDEX(bitmap_physical_start) + bitmap_pages;
-    uintptr_t bitmap_free_end_page = PAGE_INDEX(bitmap_physical_start) + MAX_BITMAP_PAGES;
-    bitmap_mark_pages(bitmap_free_begin_page, bitmap_free_end_page, false);
-    free_pages += (size_t) (bitmap_free_end_page - bitmap_free_begin_page);
-
-    // Unmap the free'd bitmap pages from kernel memory.
-    // This should be save to call from here, but when the vmm is more proper
-    // reclaiming the unused parts of the bitmap might need to be delayed until
-    // both the pmm and vmm are fully initialized.
-    for (size_t i = bitmap_pages; i < MAX_BITMAP_PAGES; ++i) {
-        assert(vmm_unmap_page(&BITMAP[i * PAGE_SIZE]) == VMM_SUCCESS);
+    free_pages -= bitmap_mark_pages(kernel_begin_page, kernel_end_page, true);
+
+    // Mark the unused parts of both bitmaps as free.
+    uint32_t* bitmaps[] = {BITMAP, PAGE_STACK_BITMAP};
+    for (size_t i = 0; i < sizeof(bitmaps) / sizeof(bitmaps[0]); ++i) {
+        uintptr_t bitmap_physical_start = (uintptr_t) KERNEL_VIRTUAL_TO_PHYSICAL(bitmaps[i]);
+        uintptr_t bitmap_free_begin_page = PAGE_INDEX(bitmap_physical_start) + bitmap_pages;
+        uintptr_t bitmap_free_end_page = PAGE_INDEX(bitmap_physical_start) + MAX_BITMAP_PAGES;
+        free_pages += bitmap_mark_pages(bitmap_free_begin_page, bitmap_free_end_page, false);
+
+        // Unmap the free'd bitmap pages from kernel memory.
+        // This should be save to call from here, but when the vmm is more proper
+        // reclaiming the unused parts of the bitmap might need to be delayed until
+        // both the pmm and vmm are fully initialized.
+        if (bitmap_pages < MAX_BITMAP_PAGES) {
+            assert(vmm_unmap_range((uint8_t*) bitmaps[i] + bitmap_pages * PAGE_SIZE, MAX_BITMAP_PAGES - bitmap_pages) == VMM_SUCCESS);
+        }
     }
 
-    return free_pages;
-}
+    memtag_add(MEMTAG_KERNEL_IMAGE, kernel_end_page - kernel_begin_page - 2 * MAX_BITMAP_PAGES);
+    memtag_add(MEMTAG_PMM, 2 * bitmap_pages);
 
-static void pmm_dump_mb_mmap(const struct multiboot* mb) {
-    log_debug("Multiboot memory map dump:");
-    log_debug("address, size, type");
-    uintptr_t entry_addr = (uintptr_t) mb->mmap_addr;
-    uintptr_t entry_end = (uintptr_t) mb->mmap_addr + mb->mmap_length;
-    while (entry_addr < entry_end) {
-        const struct multiboot_mmap_entry* entry = (struct multiboot_mmap_entry*) entry_addr;
-        uint64_t addr = entry->addr;
-        uint64_t size = entry->len;
-
-        const char* type_name = "(invalid type)";
-        switch (entry->type) {
-            case MULTIBOOT_MMAP_AVAILABLE:
-                type_name = "available";
-                break;
-            case MULTIBOOT_MMAP_RESERVED:
-                type_name = "reserved";
-                break;
-            case MULTIBOOT_MMAP_ACPI:
-                type_name = "acpi";
-                break;
-            case MULTIBOOT_MMAP_ACPI_NVS:
-                type_name = "acpi nvs";
-                break;
-            case MULTIBOOT_MMAP_DEFECTIVE:
-                type_name = "defective";
-                break;
-        }
-
-        log_debug("0x%llX, %llu KiB (%llu pages), %s", addr, size / 1024, size / PAGE_SIZE, type_name);
-        entry_addr += entry->size + sizeof(entry->size);
-    }
+    return free_pages;
 }
 
 // Note: in this function, we need to map the memory required by the physical
 // memory manager manually, as there is no virtual memory manager available yet.
-void pmm_init(const struct multiboot* mb) {
+__init void pmm_init(const struct multiboot* mb) {
     log_info("Initializing physical memory manager");
 
-    pmm_dump_mb_mmap(mb);
+    multiboot_dump_mmap(mb);
 
     size_t pages = compute_total_pages(mb);
 
@@ -230,8 +435,10 @@ void pmm_init(const struct multiboot* mb) {
     assert(bitmap_pages <= MAX_BITMAP_PAGES);
 
     PMM_STATE.total_pages = pages;
+    PMM_STATE.total_words = (pages + BITS_PER_WORD - 1) >> BITS_PER_WORD_LOG2;
     PMM_STATE.page_stack_top = 0;
     PMM_STATE.scan_index = 0;
+    PMM_STATE.largest_free_run = SIZE_MAX;
     PMM_STATE.free_pages = bitmap_init(mb, pages, bitmap_pages);
 
     log_info("%zu/%zu physical page(s) free for allocation", pmm_free_pages(), pmm_total_pages());
@@ -239,50 +446,71 @@ void pmm_init(const struct multiboot* mb) {
 
 // Find the index of an unallocated page, or a negative value if none such exist.
 // This function does not mark the page as allocated, but does update the `scan_index`.
-// TODO: Optimize
 static intptr_t pmm_find_next_free_page() {
     if (PMM_STATE.free_pages == 0)
         return -1;
 
-    uintptr_t page = PMM_STATE.scan_index;
-    for (size_t i = 0; i < PMM_STATE.total_pages; ++i) {
-        uintptr_t next_page = page + 1;
-        if (next_page == PMM_STATE.total_pages) {
-            next_page = 0;
-        }
-
-        if (!bitmap_is_allocated(page)) {
-            // Important: advancing is required here, otherwise the same page might end up twice on the stack.
-            PMM_STATE.scan_index = next_page;
-            return page;
-        }
-
-        page = next_page;
+    uintptr_t page = bitmap_find_free(PMM_STATE.scan_index, PMM_STATE.total_pages);
+    if (page == PMM_STATE.total_pages) {
+        // Nothing found until the end of memory, wrap around to the start.
+        page = bitmap_find_free(0, PMM_STATE.scan_index);
+        if (page == PMM_STATE.scan_index)
+            unreachable(); // If this was reached, PMM bookkeeping was invalid.
     }
 
-    unreachable(); // If this was reached, PMM bookkeeping was invalid.
+    // Important: advancing is required here, otherwise the same page might end up twice on the stack.
+    uintptr_t next_page = page + 1;
+    PMM_STATE.scan_index = next_page == PMM_STATE.total_pages ? 0 : next_page;
+    return page;
 }
 
-// Refill the internal stack of pages.
+// A refill must not lift the stack to the high watermark, or the next free would return the batch again.
+_Static_assert(PMM_PAGE_STACK_LOW + PMM_PAGE_STACK_BATCH < PMM_PAGE_STACK_HIGH);
+
+// Move up to a batch of pages from the bitmap to the stack.
 static void pmm_refill_stack(void) {
     size_t top = PMM_STATE.page_stack_top;
-    while (top != PMM_PAGE_STACK_ENTRIES) {
-        // Check whether there are any pages at all left to allocate.
-        // This is a performance optimization, and is also required to ensure that no two same pages end
-        // up on the stack.
+    size_t end = top + PMM_PAGE_STACK_BATCH;
+    if (end > PMM_PAGE_STACK_ENTRIES)
+        end = PMM_PAGE_STACK_ENTRIES;
+
+    while (top != end) {
+        // Check whether there are any pages left in the bitmap. This is a performance optimization,
+        // and is also required to ensure that no two same pages end up on the stack.
         if (top == PMM_STATE.free_pages)
             break;
 
         intptr_t page = pmm_find_next_free_page();
         assert(page >= 0); // Check above handles this case.
 
+        bitmap_set_allocated(page, true);
+        page_stack_set_contains(page, true);
         PMM_STATE.page_stack[top++] = page;
     }
 
-    log_debug("Refilled %zu stack entries (new top: %zu) (free: %zu)", top - PMM_STATE.page_stack_top, top, PMM_STATE.free_pages);
     PMM_STATE.page_stack_top = top;
 }
 
+// Move up to `count` pages from the top of the stack back to the bitmap.
+static void pmm_release_stack(size_t count) {
+    if (count > PMM_STATE.page_stack_top)
+        count = PMM_STATE.page_stack_top;
+
+    for (size_t i = 0; i < count; ++i) {
+        uintptr_t page = PMM_STATE.page_stack[--PMM_STATE.page_stack_top];
+        page_stack_set_contains(page, false);
+        bitmap_set_allocated(page, false);
+    }
+
+    if (count > 0)
+        PMM_STATE.largest_free_run = SIZE_MAX;
+}
+
+// Return all pages on the stack to the bitmap, so that the bitmap reflects all free pages.
+static void pmm_drain_stack(void) {
+    pmm_release_stack(PMM_STATE.page_stack_top);
+}
+
 size_t pmm_free_pages(void) {
     return PMM_STATE.free_pages;
 }
@@ -292,13 +520,14 @@ size_t pmm_total_pages(void) {
 }
 
 void pmm_mark_reserved(uintptr_t page) {
+    pmm_drain_stack();
     assert(!bitmap_is_allocated(page));
     bitmap_set_allocated(page, true);
-    PMM_STATE.page_stack_top = 0;
+    --PMM_STATE.free_pages;
 }
 
 bool pmm_is_free(uintptr_t page) {
-    return !bitmap_is_allocated(page);
+    return !bitmap_is_allocated(page) || page_stack_contains(page);
 }
 
 intptr_t pmm_alloc(void) {
@@ -306,27 +535,113 @@ intptr_t pmm_alloc(void) {
         return -1;
     }
 
-    if (PMM_STATE.page_stack_top == 0) {
+    // At or below the low watermark, take a batch of pages from the bitmap before the stack runs empty. The
+    // bitmap holds the free pages that are not on the stack, if it has none there is nothing to refill.
+    if (PMM_STATE.page_stack_top <= PMM_PAGE_STACK_LOW && PMM_STATE.free_pages > PMM_STATE.page_stack_top) {
+        uint32_t start = pmm_latency_start();
         pmm_refill_stack();
+        pmm_latency_record(start);
     }
 
     assert(PMM_STATE.page_stack_top != 0); // If this is reached, bookkeeping of `free_pages` was incorrect.
 
     intptr_t page = PMM_STATE.page_stack[--PMM_STATE.page_stack_top];
-
-    bitmap_set_allocated(page, true);
+    page_stack_set_contains(page, false);
     --PMM_STATE.free_pages;
     return page;
 }
 
 void pmm_free(uintptr_t page) {
-    assert(bitmap_is_allocated(page));
-    // if the stack is not full, put the free'd page on top of it.
-    if (PMM_STATE.page_stack_top != PMM_PAGE_STACK_ENTRIES) {
-        PMM_STATE.page_stack[PMM_STATE.page_stack_top++] = page;
+    assert(!pmm_is_free(page));
+
+    // At or above the high watermark, return a batch of pages to the bitmap at once.
+    if (PMM_STATE.page_stack_top >= PMM_PAGE_STACK_HIGH) {
+        pmm_release_stack(PMM_PAGE_STACK_BATCH);
     }
 
-    bitmap_set_allocated(page, false);
+    page_stack_set_contains(page, true);
+    PMM_STATE.page_stack[PMM_STATE.page_stack_top++] = page;
     ++PMM_STATE.free_pages;
 }
 
+intptr_t pmm_alloc_contiguous(size_t count, size_t align_pages) {
+    assert(count > 0);
+    assert(align_pages > 0 && (align_pages & (align_pages - 1)) == 0);
+
+    // `largest_free_run` only covers the bitmap, pages on the stack might extend a run.
+    if (count > PMM_STATE.free_pages || (count > PMM_STATE.largest_free_run && PMM_STATE.page_stack_top == 0))
+        return -1;
+
+    size_t largest_run;
+    intptr_t page = bitmap_find_run(count, align_pages, &largest_run);
+    if (page < 0 && PMM_STATE.page_stack_top > 0) {
+        pmm_drain_stack();
+        page = bitmap_find_run(count, align_pages, &largest_run);
+    }
+
+    if (page < 0) {
+        PMM_STATE.largest_free_run = largest_run;
+        return -1;
+    }
+
+    size_t allocated = bitmap_mark_pages(page, page + count, true);
+    assert(allocated == count);
+    PMM_STATE.free_pages -= count;
+    return page;
+}
+
+void pmm_free_contiguous(uintptr_t page, size_t count) {
+    assert(page <= PMM_STATE.total_pages && count <= PMM_STATE.total_pages - page);
+    // Pages on the stack are free, so none of the pages may be on it.
+    assert(words_count_bits(PAGE_STACK_BITMAP, page, page + count) == 0);
+    size_t freed = bitmap_mark_pages(page, page + count, false);
+    assert(freed == count); // All pages should have been allocated.
+    PMM_STATE.free_pages += count;
+    PMM_STATE.largest_free_run = SIZE_MAX;
+}
+
+size_t pmm_largest_free_run(void) {
+    pmm_drain_stack();
+    size_t largest_run;
+    bitmap_find_run(SIZE_MAX, 1, &largest_run);
+    PMM_STATE.largest_free_run = largest_run;
+    return largest_run;
+}
+
+intptr_t pmm_alloc_order(unsigned order) {
+    assert(order <= PMM_MAX_ORDER);
+    return pmm_alloc_contiguous(1U << order, 1U << order);
+}
+
+void pmm_free_order(uintptr_t page, unsigned order) {
+    assert(order <= PMM_MAX_ORDER);
+    pmm_free_contiguous(page, 1U << order);
+}
+
+void pmm_log_fragmentation(void) {
+    pmm_drain_stack();
+    size_t runs = 0;
+    size_t largest = 0;
+
+    uintptr_t page = 0;
+    while (page < PMM_STATE.total_pages) {
+        uintptr_t run_begin = bitmap_find_free(page, PMM_STATE.total_pages);
+        if (run_begin == PMM_STATE.total_pages)
+            break;
+
+        uintptr_t run_end = bitmap_find_allocated(run_begin, PMM_STATE.total_pages);
+        if (run_end - run_begin > largest)
+            largest = run_end - run_begin;
+
+        ++runs;
+        page = run_end;
+    }
+
+    PMM_STATE.largest_free_run = largest;
+
+    log_info("%zu/%zu physical page(s) free in %zu run(s), largest run: %zu page(s)", PMM_STATE.free_pages, PMM_STATE.total_pages, runs, largest);
+    // The fragmentation is the percentage of free memory which cannot be used for the largest possible allocation.
+    if (PMM_STATE.free_pages > 0) {
+        log_info("Fragmentation: %zu%%", 100 - largest * 100 / PMM_STATE.free_pages);
+    }
+}
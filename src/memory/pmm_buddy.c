@@ -0,0 +1,409 @@
+#include "memory/pmm.h"
+#include "memory/vmm.h"
+#include "memory/align.h"
+#include "memory/page_table.h"
+#include "memory/kernel_layout.h"
+#include "memory/memtag.h"
+#include "core/init.h"
+
+#include "debug/assert.h"
+#include "debug/log.h"
+#include "utility/bitops.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// The maximum number of pages that the buddy allocator manages, memory above this is ignored.
+// This is 512 MiB of memory.
+#define BUDDY_MAX_PAGES (128U * 1024U)
+
+// The value of `BUDDY_ORDER` for pages which are not the first page of a free block.
+#define BUDDY_NOT_FREE (0xFFU)
+
+// Marks the end of a free list.
+#define BUDDY_NONE (UINT32_MAX)
+
+// Links of a free block in the free list of its order, as page indices.
+struct buddy_links {
+    uint32_t next;
+    uint32_t prev;
+};
+
+static struct {
+    // The total amount of pages the system has to keep track of.
+    // Physical pages are assumed to exist for addresses 0 < x < `pages`.
+    size_t total_pages;
+
+    // The total amount of pages currently available for allocation.
+    size_t free_pages;
+
+    // The first free block of each order, or `BUDDY_NONE` if there is none.
+    uint32_t free_lists[PMM_MAX_ORDER + 1];
+
+    // The number of free blocks of each order.
+    size_t free_blocks[PMM_MAX_ORDER + 1];
+} PMM_STATE;
+
+// Per-page metadata. Like the bitmap of the bitmap allocator, these arrays are sized for the maximum
+// amount of memory. The parts which are not used are returned to the allocator after initialization.
+// The free list links of a block are only valid for the first page of a free block.
+static struct buddy_links BUDDY_LINKS[BUDDY_MAX_PAGES] __attribute__((aligned(PAGE_SIZE)));
+
+// The order of the free block which starts at a page, or `BUDDY_NOT_FREE`.
+static uint8_t BUDDY_ORDER[BUDDY_MAX_PAGES] __attribute__((aligned(PAGE_SIZE)));
+
+// Compute the total number of pages that the system has to keep track of.
+// This entails the number of pages from physical address 0 to the physical page
+// with the largest address.
+__init static size_t compute_total_pages(const struct multiboot* mb) {
+    uint64_t max_addr = 0;
+
+    uintptr_t entry_addr = (uintptr_t) mb->mmap_addr;
+    uintptr_t entry_end = (uintptr_t) mb->mmap_addr + mb->mmap_length;
+    while (entry_addr < entry_end) {
+        const struct multiboot_mmap_entry* entry = (struct multiboot_mmap_entry*) entry_addr;
+
+        uint64_t end = entry->addr + entry->len;
+
+        if (entry->type == MULTIBOOT_MMAP_AVAILABLE && end > max_addr)
+            max_addr = end;
+
+        entry_addr += entry->size + sizeof(entry->size);
+    }
+
+    // Use a shift here to avoid 64-bit division.
+    uint64_t pages = max_addr >> PAGE_OFFSET_BITS;
+    if (pages > BUDDY_MAX_PAGES) {
+        log_warn("Buddy allocator only manages the first %u MiB of memory", BUDDY_MAX_PAGES / (1024 * 1024 / PAGE_SIZE));
+        pages = BUDDY_MAX_PAGES;
+    }
+
+    return (size_t) pages;
+}
+
+// Add a free block to the free list of its order.
+static void buddy_list_push(uintptr_t page, unsigned order) {
+    uint32_t head = PMM_STATE.free_lists[order];
+    BUDDY_LINKS[page] = (struct buddy_links){
+        .next = head,
+        .prev = BUDDY_NONE,
+    };
+
+    if (head != BUDDY_NONE)
+        BUDDY_LINKS[head].prev = page;
+
+    PMM_STATE.free_lists[order] = page;
+    BUDDY_ORDER[page] = order;
+    ++PMM_STATE.free_blocks[order];
+}
+
+// Remove a free block from the free list of its order.
+static void buddy_list_remove(uintptr_t page) {
+    unsigned order = BUDDY_ORDER[page];
+    assert(order <= PMM_MAX_ORDER);
+
+    const struct buddy_links* links = &BUDDY_LINKS[page];
+    if (links->prev != BUDDY_NONE) {
+        BUDDY_LINKS[links->prev].next = links->next;
+    } else {
+        PMM_STATE.free_lists[order] = links->next;
+    }
+
+    if (links->next != BUDDY_NONE)
+        BUDDY_LINKS[links->next].prev = links->prev;
+
+    BUDDY_ORDER[page] = BUDDY_NOT_FREE;
+    --PMM_STATE.free_blocks[order];
+}
+
+// Return a block to the free lists, and coalesce it with its buddy for as long as the buddy is also free.
+static void buddy_free_block(uintptr_t page, unsigned order) {
+    while (order < PMM_MAX_ORDER) {
+        uintptr_t buddy = page ^ (1U << order);
+        if (buddy >= PMM_STATE.total_pages || BUDDY_ORDER[buddy] != order)
+            break;
+
+        buddy_list_remove(buddy);
+        page &= ~(1U << order);
+        ++order;
+    }
+
+    buddy_list_push(page, order);
+}
+
+// Take a block of a particular order from the free lists, splitting a larger block if required.
+// Returns the first page of the block, or a negative value if there is no block large enough.
+static intptr_t buddy_alloc_block(unsigned order) {
+    unsigned current = order;
+    while (current <= PMM_MAX_ORDER && PMM_STATE.free_lists[current] == BUDDY_NONE)
+        ++current;
+
+    if (current > PMM_MAX_ORDER)
+        return -1;
+
+    uintptr_t page = PMM_STATE.free_lists[current];
+    buddy_list_remove(page);
+
+    // Return the upper halves to the free lists until the block has the right size.
+    while (current > order) {
+        --current;
+        buddy_list_push(page + (1U << current), current);
+    }
+
+    return page;
+}
+
+// Find the free block which contains a page.
+// Returns the first page of the block and stores its order in `order`, or returns a negative
+// value if the page is not free.
+static intptr_t buddy_find_free_block(uintptr_t page, unsigned* order) {
+    assert(page < PMM_STATE.total_pages);
+    for (unsigned i = 0; i <= PMM_MAX_ORDER; ++i) {
+        uintptr_t block = ALIGN_BACKWARD_2POW(page, 1U << i);
+        if (BUDDY_ORDER[block] == i) {
+            *order = i;
+            return block;
+        }
+    }
+
+    return -1;
+}
+
+// Return all pages in the range [begin, end) to the free lists, in the largest aligned blocks possible.
+static void buddy_free_range(uintptr_t begin, uintptr_t end) {
+    assert(begin <= end && end <= PMM_STATE.total_pages);
+    while (begin < end) {
+        unsigned order = begin == 0 ? PMM_MAX_ORDER : bit_scan_forward(begin);
+        if (order > PMM_MAX_ORDER)
+            order = PMM_MAX_ORDER;
+
+        while ((1U << order) > end - begin)
+            --order;
+
+        buddy_free_block(begin, order);
+        begin += 1U << order;
+    }
+}
+
+// Return the range [begin, end) of pages to the free lists, except for the part that overlaps with
+// the range [hole_begin, hole_end).
+// Returns the number of pages freed.
+__init static size_t buddy_free_range_except(uintptr_t begin, uintptr_t end, uintptr_t hole_begin, uintptr_t hole_end) {
+    size_t freed = 0;
+    if (begin < hole_begin) {
+        uintptr_t part_end = end < hole_begin ? end : hole_begin;
+        buddy_free_range(begin, part_end);
+        freed += part_end - begin;
+    }
+
+    if (end > hole_end) {
+        uintptr_t part_begin = begin > hole_end ? begin : hole_end;
+        buddy_free_range(part_begin, end);
+        freed += end - part_begin;
+    }
+
+    return freed;
+}
+
+// Seed the free lists from the memory map. All memory which is available, except for the kernel
+// itself, is added to the free lists. Afterwards, the unused parts of the page metadata are freed.
+// Returns the total number of free pages.
+__init static size_t buddy_init(const struct multiboot* mb, size_t pages) {
+    size_t free_pages = 0;
+
+    for (unsigned i = 0; i <= PMM_MAX_ORDER; ++i) {
+        PMM_STATE.free_lists[i] = BUDDY_NONE;
+        PMM_STATE.free_blocks[i] = 0;
+    }
+
+    memset(BUDDY_ORDER, BUDDY_NOT_FREE, pages);
+
+    uintptr_t kernel_begin_page = PAGE_INDEX(KERNEL_PHYSICAL_START);
+    uintptr_t kernel_end_page = PAGE_INDEX(PAGE_ALIGN_FORWARD(KERNEL_PHYSICAL_END));
+
+    uintptr_t entry_addr = (uintptr_t) mb->mmap_addr;
+    uintptr_t entry_end = (uintptr_t) mb->mmap_addr + mb->mmap_length;
+    while (entry_addr < entry_end) {
+        const struct multiboot_mmap_entry* entry = (struct multiboot_mmap_entry*) entry_addr;
+
+        if (entry->type == MULTIBOOT_MMAP_AVAILABLE) {
+            // Round first page up and last page down.
+            uint64_t begin_page = PAGE_INDEX(PAGE_ALIGN_FORWARD(entry->addr));
+            uint64_t end_page = PAGE_INDEX(entry->addr + entry->len);
+
+            if (begin_page < pages) {
+                // Note that after this point, the value is guaranteed to be small enough for 32-bit variables.
+                if (end_page > pages)
+                    end_page = pages;
+
+                free_pages += buddy_free_range_except((uintptr_t) begin_page, (uintptr_t) end_page, kernel_begin_page, kernel_end_page);
+            }
+        }
+
+        entry_addr += entry->size + sizeof(entry->size);
+    }
+
+    // Free the unused parts of the page metadata, which are inside the kernel image.
+    size_t links_pages = PAGE_INDEX(PAGE_ALIGN_FORWARD(pages * sizeof(struct buddy_links)));
+    size_t order_pages = PAGE_INDEX(PAGE_ALIGN_FORWARD(pages * sizeof(uint8_t)));
+    log_info("Buddy allocator requires %zu page(s) of metadata", links_pages + order_pages);
+    memtag_add(MEMTAG_KERNEL_IMAGE, kernel_end_page - kernel_begin_page - (sizeof(BUDDY_LINKS) + sizeof(BUDDY_ORDER)) / PAGE_SIZE);
+    memtag_add(MEMTAG_PMM, links_pages + order_pages);
+
+    uintptr_t links_physical_page = PAGE_INDEX((uintptr_t) KERNEL_VIRTUAL_TO_PHYSICAL(BUDDY_LINKS));
+    buddy_free_range(links_physical_page + links_pages, links_physical_page + sizeof(BUDDY_LINKS) / PAGE_SIZE);
+    free_pages += sizeof(BUDDY_LINKS) / PAGE_SIZE - links_pages;
+
+    uintptr_t order_physical_page = PAGE_INDEX((uintptr_t) KERNEL_VIRTUAL_TO_PHYSICAL(BUDDY_ORDER));
+    buddy_free_range(order_physical_page + order_pages, order_physical_page + sizeof(BUDDY_ORDER) / PAGE_SIZE);
+    free_pages += sizeof(BUDDY_ORDER) / PAGE_SIZE - order_pages;
+
+    // Unmap the free'd metadata pages from kernel memory.
+    if (links_pages < sizeof(BUDDY_LINKS) / PAGE_SIZE) {
+        assert(vmm_unmap_range((uint8_t*) BUDDY_LINKS + links_pages * PAGE_SIZE, sizeof(BUDDY_LINKS) / PAGE_SIZE - links_pages) == VMM_SUCCESS);
+    }
+
+    if (order_pages < sizeof(BUDDY_ORDER) / PAGE_SIZE) {
+        assert(vmm_unmap_range((uint8_t*) BUDDY_ORDER + order_pages * PAGE_SIZE, sizeof(BUDDY_ORDER) / PAGE_SIZE - order_pages) == VMM_SUCCESS);
+    }
+
+    return free_pages;
+}
+
+__init void pmm_init(const struct multiboot* mb) {
+    log_info("Initializing physical memory manager (buddy allocator)");
+
+    multiboot_dump_mmap(mb);
+
+    size_t pages = compute_total_pages(mb);
+    log_info("%zu system page(s)", pages);
+
+    PMM_STATE.total_pages = pages;
+    PMM_STATE.free_pages = buddy_init(mb, pages);
+
+    log_info("%zu/%zu physical page(s) free for allocation", pmm_free_pages(), pmm_total_pages());
+}
+
+size_t pmm_free_pages(void) {
+    return PMM_STATE.free_pages;
+}
+
+size_t pmm_total_pages(void) {
+    return PMM_STATE.total_pages;
+}
+
+void pmm_mark_reserved(uintptr_t page) {
+    unsigned order;
+    intptr_t block = buddy_find_free_block(page, &order);
+    assert(block >= 0);
+
+    buddy_list_remove(block);
+
+    // Split the block, and return the halves which do not contain the page.
+    while (order > 0) {
+        --order;
+        uintptr_t half = 1U << order;
+        if (page < block + half) {
+            buddy_list_push(block + half, order);
+        } else {
+            buddy_list_push(block, order);
+            block += half;
+        }
+    }
+
+    --PMM_STATE.free_pages;
+}
+
+bool pmm_is_free(uintptr_t page) {
+    unsigned order;
+    return buddy_find_free_block(page, &order) >= 0;
+}
+
+intptr_t pmm_alloc(void) {
+    // Taking a page from the list of single pages is not measured, only splitting a larger block is.
+    if (PMM_STATE.free_lists[0] != BUDDY_NONE)
+        return pmm_alloc_order(0);
+
+    uint32_t start = pmm_latency_start();
+    intptr_t page = pmm_alloc_order(0);
+    pmm_latency_record(start);
+    return page;
+}
+
+void pmm_free(uintptr_t page) {
+    pmm_free_order(page, 0);
+}
+
+intptr_t pmm_alloc_order(unsigned order) {
+    assert(order <= PMM_MAX_ORDER);
+    intptr_t page = buddy_alloc_block(order);
+    if (page >= 0)
+        PMM_STATE.free_pages -= 1U << order;
+    return page;
+}
+
+void pmm_free_order(uintptr_t page, unsigned order) {
+    assert(order <= PMM_MAX_ORDER);
+    assert(IS_ALIGNED_TO(page, 1U << order));
+    assert(!pmm_is_free(page));
+    buddy_free_block(page, order);
+    PMM_STATE.free_pages += 1U << order;
+}
+
+intptr_t pmm_alloc_contiguous(size_t count, size_t align_pages) {
+    assert(count > 0);
+    assert(align_pages > 0 && (align_pages & (align_pages - 1)) == 0);
+
+    // Blocks are aligned to their size, so round up to a block which satisfies both.
+    size_t block_pages = count > align_pages ? count : align_pages;
+    unsigned order = 0;
+    while ((1U << order) < block_pages) {
+        if (++order > PMM_MAX_ORDER)
+            return -1;
+    }
+
+    intptr_t page = buddy_alloc_block(order);
+    if (page < 0)
+        return -1;
+
+    // Return the part of the block that was not requested.
+    buddy_free_range(page + count, page + (1U << order));
+    PMM_STATE.free_pages -= count;
+    return page;
+}
+
+void pmm_free_contiguous(uintptr_t page, size_t count) {
+    assert(page <= PMM_STATE.total_pages && count <= PMM_STATE.total_pages - page);
+    assert(!pmm_is_free(page));
+    buddy_free_range(page, page + count);
+    PMM_STATE.free_pages += count;
+}
+
+size_t pmm_largest_free_run(void) {
+    // Note: Adjacent free blocks which are not buddies may form a larger run, but these cannot be
+    // allocated as a whole anyway.
+    for (unsigned i = PMM_MAX_ORDER + 1; i > 0; --i) {
+        if (PMM_STATE.free_blocks[i - 1] > 0)
+            return 1U << (i - 1);
+    }
+
+    return 0;
+}
+
+void pmm_log_fragmentation(void) {
+    log_info("%zu/%zu physical page(s) free", PMM_STATE.free_pages, PMM_STATE.total_pages);
+    for (unsigned i = 0; i <= PMM_MAX_ORDER; ++i) {
+        log_info("Order %2u (%4u page(s)): %zu free block(s)", i, 1U << i, PMM_STATE.free_blocks[i]);
+    }
+
+    // The fragmentation is the percentage of free memory which cannot be used for the largest possible allocation.
+    if (PMM_STATE.free_pages > 0) {
+        size_t usable = 0;
+        for (unsigned i = 0; i <= PMM_MAX_ORDER; ++i) {
+            if (PMM_STATE.free_blocks[i] > 0)
+                usable = PMM_STATE.free_blocks[i] << i;
+        }
+        log_info("Fragmentation: %zu%%", 100 - usable * 100 / PMM_STATE.free_pages);
+    }
+}
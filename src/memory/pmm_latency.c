@@ -0,0 +1,64 @@
+#include "memory/pmm.h"
+
+#include "core/cpu.h"
+#include "core/init.h"
+#include "driver/pit/pit.h"
+#include "utility/bitops.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The histogram is shared by the backends. Nothing is recorded until `pmm_latency_init` has selected a
+// time source, which sets `unit`.
+static struct pmm_latency_histogram PMM_LATENCY;
+
+static bool PMM_LATENCY_USE_TSC = false;
+
+__init void pmm_latency_init(void) {
+    PMM_LATENCY_USE_TSC = cpu_has_feature(CPU_FEATURE_TSC);
+    if (PMM_LATENCY_USE_TSC) {
+        PMM_LATENCY.unit = "cycles";
+        PMM_LATENCY.min_log2 = PMM_LATENCY_MIN_LOG2;
+    } else {
+        // Reading the PIT takes a few I/O port accesses, which is slow but still well below the time the
+        // slow path of an allocation takes.
+        pit_start_counter();
+        PMM_LATENCY.unit = "PIT ticks";
+        PMM_LATENCY.min_log2 = PMM_LATENCY_PIT_MIN_LOG2;
+    }
+}
+
+uint32_t pmm_latency_start(void) {
+    // Only the low half of the counter is needed: allocations never take 2^32 cycles.
+    if (PMM_LATENCY_USE_TSC)
+        return (uint32_t) cpu_read_tsc();
+    return PMM_LATENCY.unit ? pit_read_counter() : 0;
+}
+
+void pmm_latency_record(uint32_t start) {
+    uint32_t time;
+    if (PMM_LATENCY_USE_TSC) {
+        time = (uint32_t) cpu_read_tsc() - start;
+    } else if (PMM_LATENCY.unit) {
+        // The PIT counts down, and wraps every 65536 ticks.
+        time = (uint16_t) (start - pit_read_counter());
+    } else {
+        return;
+    }
+
+    if (time > PMM_LATENCY.max_time)
+        PMM_LATENCY.max_time = time;
+
+    size_t bucket = 0;
+    if (time >= 1U << PMM_LATENCY.min_log2) {
+        bucket = bit_scan_reverse(time) - PMM_LATENCY.min_log2 + 1;
+        if (bucket >= PMM_LATENCY_BUCKETS)
+            bucket = PMM_LATENCY_BUCKETS - 1;
+    }
+
+    ++PMM_LATENCY.buckets[bucket];
+}
+
+void pmm_get_alloc_latency(struct pmm_latency_histogram* histogram) {
+    *histogram = PMM_LATENCY;
+}
@@ -0,0 +1,57 @@
+#include "memory/pmm.h"
+#include "memory/vmm.h"
+#include "memory/vm_region.h"
+#include "memory/page_table.h"
+
+#include "core/init.h"
+
+#include "debug/assert.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// For every physical page, the number of references to it in addition to the first. Like the pool of
+// pre-zeroed pages, this is kept outside of the backends. The table is indexed the same way as the
+// allocation bitmap, but it is demand-paged: only the parts covering pages that were ever shared
+// take up memory, and those start out zeroed, meaning that the pages have a single owner. Reads check
+// whether the part they need is mapped, so that they do not fault it in just to find a zero.
+static uint16_t* PMM_REF_COUNTS = NULL;
+
+__init void pmm_ref_init(void) {
+    size_t size = PAGE_ALIGN_FORWARD(pmm_total_pages() * sizeof(uint16_t));
+    struct vm_region* region = vm_region_alloc_kernel("pmm_refcount", size, VMM_MAP_WRITABLE);
+    assert(region);
+    PMM_REF_COUNTS = (uint16_t*) region->range.base;
+}
+
+// Return the number of references to `page` in addition to the first.
+static uint16_t pmm_ref_count(uintptr_t page) {
+    if (!PMM_REF_COUNTS)
+        return 0;
+
+    void* physical;
+    uint16_t* count = &PMM_REF_COUNTS[page];
+    return vmm_translate(count, &physical) == VMM_SUCCESS ? *count : 0;
+}
+
+void pmm_ref_page(uintptr_t page) {
+    assert(PMM_REF_COUNTS && page < pmm_total_pages() && !pmm_is_free(page));
+    assert(PMM_REF_COUNTS[page] < UINT16_MAX);
+    ++PMM_REF_COUNTS[page];
+}
+
+bool pmm_unref_page(uintptr_t page) {
+    assert(page < pmm_total_pages());
+    if (pmm_ref_count(page) > 0) {
+        --PMM_REF_COUNTS[page];
+        return false;
+    }
+
+    pmm_free(page);
+    return true;
+}
+
+size_t pmm_page_refs(uintptr_t page) {
+    assert(page < pmm_total_pages());
+    return pmm_ref_count(page) + 1U;
+}
@@ -0,0 +1,64 @@
+#include "memory/pmm.h"
+#include "memory/vmm.h"
+#include "memory/memtag.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The pool is only refilled while more than this number of pages is free, so that it does not
+// take memory away when the system is running low.
+#define PMM_ZERO_MIN_FREE_PAGES (PMM_ZERO_POOL_ENTRIES * 4)
+
+// The pool of pre-zeroed pages is kept separately from the backends, so that it works with any of them.
+// Pages in the pool are allocated as far as the backend is concerned.
+static struct {
+    struct pmm_zero_stats stats;
+
+    // Stack of zeroed physical page indices. The number of entries is `stats.pool_pages`.
+    uintptr_t pool[PMM_ZERO_POOL_ENTRIES];
+} PMM_ZERO_STATE;
+
+intptr_t pmm_alloc_zeroed(void) {
+    if (PMM_ZERO_STATE.stats.pool_pages > 0) {
+        ++PMM_ZERO_STATE.stats.pool_hits;
+        memtag_remove(MEMTAG_ZERO_POOL, 1);
+        return PMM_ZERO_STATE.pool[--PMM_ZERO_STATE.stats.pool_pages];
+    }
+
+    intptr_t page = pmm_alloc();
+    if (PMM_ALLOC_FAILED(page))
+        return page;
+
+    vmm_zero_page(page);
+    ++PMM_ZERO_STATE.stats.sync_zeroed;
+    return page;
+}
+
+bool pmm_zero_idle(void) {
+    if (PMM_ZERO_STATE.stats.pool_pages == PMM_ZERO_POOL_ENTRIES || pmm_free_pages() <= PMM_ZERO_MIN_FREE_PAGES)
+        return false;
+
+    intptr_t page = pmm_alloc();
+    if (PMM_ALLOC_FAILED(page))
+        return false;
+
+    vmm_zero_page(page);
+    PMM_ZERO_STATE.pool[PMM_ZERO_STATE.stats.pool_pages++] = page;
+    ++PMM_ZERO_STATE.stats.idle_zeroed;
+    memtag_add(MEMTAG_ZERO_POOL, 1);
+    return true;
+}
+
+size_t pmm_zero_drain(void) {
+    size_t pages = PMM_ZERO_STATE.stats.pool_pages;
+    while (PMM_ZERO_STATE.stats.pool_pages > 0) {
+        pmm_free(PMM_ZERO_STATE.pool[--PMM_ZERO_STATE.stats.pool_pages]);
+    }
+
+    memtag_remove(MEMTAG_ZERO_POOL, pages);
+    return pages;
+}
+
+void pmm_get_zero_stats(struct pmm_zero_stats* stats) {
+    *stats = PMM_ZERO_STATE.stats;
+}
@@ -0,0 +1,330 @@
+#include "memory/slab.h"
+#include "memory/heap.h"
+#include "memory/pmm.h"
+#include "memory/physmap.h"
+#include "memory/align.h"
+#include "memory/page_table.h"
+#include "memory/memtag.h"
+
+#include "debug/assert.h"
+#include "debug/console/console.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+// The alignment of objects if the cache does not specify one.
+#define KMEM_DEFAULT_ALIGN (8U)
+
+// The number of empty slabs a cache keeps around before releasing them. Keeping one avoids
+// repeatedly creating and releasing a slab when a single object is allocated and freed.
+#define KMEM_MAX_EMPTY_SLABS (1U)
+
+// Header of a slab. A slab occupies a single page, and this header is stored at the start of it. The header
+// is followed by the indices of the free objects, and then by the objects themselves. Because the free list
+// is kept outside of the objects, they remain in their constructed state while they are not allocated.
+struct kmem_slab {
+    struct kmem_cache* cache;
+
+    // Links in the partial, full or empty list of the cache.
+    struct kmem_slab* next;
+    struct kmem_slab* prev;
+
+    // The first object in this slab. This depends on the colour of the slab.
+    uint8_t* objects;
+
+    // The number of free objects, and the stack of their indices.
+    uint16_t free_count;
+    uint16_t free[];
+};
+
+struct kmem_cache {
+    char name[KMEM_CACHE_NAME_SIZE];
+
+    // The size of an object, rounded up to its alignment.
+    size_t object_size;
+    size_t objects_per_slab;
+
+    // The offset of the first object in an uncoloured slab.
+    size_t objects_offset;
+
+    // Consecutive slabs offset their objects by `colour_step` bytes more than the previous, until the
+    // space left over at the end of the slab runs out.
+    size_t colour_step;
+    size_t colours;
+    size_t colour_next;
+
+    kmem_ctor ctor;
+
+    // Slabs with some free objects, no free objects, and only free objects, respectively.
+    struct kmem_slab* partial_slabs;
+    struct kmem_slab* full_slabs;
+    struct kmem_slab* empty_slabs;
+
+    struct kmem_cache_stats stats;
+
+    // Links in the list of all caches.
+    struct kmem_cache* next;
+    struct kmem_cache* prev;
+};
+
+// The cache from which all other caches are allocated. Its layout is computed on the first call
+// to `kmem_cache_create`.
+static struct kmem_cache KMEM_CACHE_CACHE;
+
+// The list of all caches, including `KMEM_CACHE_CACHE`.
+static struct kmem_cache* KMEM_CACHES = NULL;
+
+static void kmem_slab_push(struct kmem_slab** list, struct kmem_slab* slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list)
+        (*list)->prev = slab;
+    *list = slab;
+}
+
+static void kmem_slab_remove(struct kmem_slab** list, struct kmem_slab* slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+
+    if (slab->next)
+        slab->next->prev = slab->prev;
+}
+
+// Compute the layout of the slabs of `cache`, and add it to the list of caches.
+static void kmem_cache_init(struct kmem_cache* cache, const char* name, size_t size, size_t align, kmem_ctor ctor) {
+    if (align == 0)
+        align = KMEM_DEFAULT_ALIGN;
+
+    assert((align & (align - 1)) == 0 && align <= KMEM_MAX_OBJECT_SIZE);
+    assert(size > 0 && size <= KMEM_MAX_OBJECT_SIZE);
+
+    *cache = (struct kmem_cache){
+        .object_size = ALIGN_FORWARD_2POW(size, align),
+        .ctor = ctor,
+    };
+
+    size_t name_len = strlen(name);
+    if (name_len >= KMEM_CACHE_NAME_SIZE)
+        name_len = KMEM_CACHE_NAME_SIZE - 1;
+    memcpy(cache->name, name, name_len);
+    cache->name[name_len] = '\0';
+
+    // Start from an upper bound on the number of objects, and lower it until the header and the
+    // objects fit together in a page.
+    size_t objects = (PAGE_SIZE - sizeof(struct kmem_slab)) / (cache->object_size + sizeof(uint16_t));
+    size_t offset;
+    while (true) {
+        offset = ALIGN_FORWARD_2POW(sizeof(struct kmem_slab) + objects * sizeof(uint16_t), align);
+        if (offset + objects * cache->object_size <= PAGE_SIZE)
+            break;
+        --objects;
+    }
+
+    assert(objects > 0);
+    cache->objects_per_slab = objects;
+    cache->objects_offset = offset;
+
+    cache->colour_step = align > KMEM_CACHE_LINE_SIZE ? align : KMEM_CACHE_LINE_SIZE;
+    cache->colours = (PAGE_SIZE - offset - objects * cache->object_size) / cache->colour_step + 1;
+
+    cache->next = KMEM_CACHES;
+    cache->prev = NULL;
+    if (KMEM_CACHES)
+        KMEM_CACHES->prev = cache;
+    KMEM_CACHES = cache;
+}
+
+// Allocate the page for a slab. Pages are taken from the physical memory map where possible, so that they
+// do not need to be mapped. Pages outside of it are mapped in the kernel heap area instead.
+static void* kmem_page_alloc(void) {
+    intptr_t page = pmm_alloc();
+    if (!PMM_ALLOC_FAILED(page) && physmap_contains_page(page)) {
+        memtag_add(MEMTAG_SLAB, 1);
+        return phys_to_virt(page << PAGE_OFFSET_BITS);
+    }
+
+    if (!PMM_ALLOC_FAILED(page))
+        pmm_free(page);
+
+    return heap_alloc_pages(1);
+}
+
+static void kmem_page_free(void* ptr) {
+    if (physmap_contains_virtual(ptr)) {
+        pmm_free(PAGE_INDEX(virt_to_phys(ptr)));
+        memtag_remove(MEMTAG_SLAB, 1);
+    } else {
+        heap_free_pages(ptr, 1);
+    }
+}
+
+// Create a new slab for `cache`, and construct all of its objects.
+// Returns NULL if there is not enough memory.
+static struct kmem_slab* kmem_slab_create(struct kmem_cache* cache) {
+    struct kmem_slab* slab = kmem_page_alloc();
+    if (!slab)
+        return NULL;
+
+    size_t colour = cache->colour_next;
+    cache->colour_next = colour + 1 == cache->colours ? 0 : colour + 1;
+
+    slab->cache = cache;
+    slab->objects = (uint8_t*) slab + cache->objects_offset + colour * cache->colour_step;
+    slab->free_count = cache->objects_per_slab;
+
+    // Push the indices in reverse, so that objects are handed out in address order.
+    for (size_t i = 0; i < cache->objects_per_slab; ++i) {
+        slab->free[i] = cache->objects_per_slab - i - 1;
+        if (cache->ctor)
+            cache->ctor(slab->objects + i * cache->object_size);
+    }
+
+    ++cache->stats.slabs;
+    return slab;
+}
+
+static void kmem_slab_release(struct kmem_cache* cache, struct kmem_slab* slab) {
+    assert(slab->free_count == cache->objects_per_slab);
+    --cache->stats.slabs;
+    kmem_page_free(slab);
+}
+
+struct kmem_cache* kmem_cache_create(const char* name, size_t size, size_t align, kmem_ctor ctor) {
+    if (KMEM_CACHE_CACHE.object_size == 0)
+        kmem_cache_init(&KMEM_CACHE_CACHE, "kmem_cache", sizeof(struct kmem_cache), 0, NULL);
+
+    struct kmem_cache* cache = kmem_cache_alloc(&KMEM_CACHE_CACHE);
+    if (!cache)
+        return NULL;
+
+    kmem_cache_init(cache, name, size, align, ctor);
+    return cache;
+}
+
+void kmem_cache_destroy(struct kmem_cache* cache) {
+    assert(cache != &KMEM_CACHE_CACHE);
+    assert(cache->stats.active_objects == 0 && !cache->partial_slabs && !cache->full_slabs);
+    kmem_cache_reclaim(cache);
+
+    if (cache->prev) {
+        cache->prev->next = cache->next;
+    } else {
+        KMEM_CACHES = cache->next;
+    }
+
+    if (cache->next)
+        cache->next->prev = cache->prev;
+
+    kmem_cache_free(&KMEM_CACHE_CACHE, cache);
+}
+
+void* kmem_cache_alloc(struct kmem_cache* cache) {
+    struct kmem_slab* slab = cache->partial_slabs;
+    if (slab) {
+        ++cache->stats.hits;
+    } else if (cache->empty_slabs) {
+        slab = cache->empty_slabs;
+        kmem_slab_remove(&cache->empty_slabs, slab);
+        kmem_slab_push(&cache->partial_slabs, slab);
+        --cache->stats.empty_slabs;
+        ++cache->stats.hits;
+    } else {
+        ++cache->stats.misses;
+        slab = kmem_slab_create(cache);
+
+        // Try again after the empty slabs of other caches and the pre-zeroed pages were released.
+        if (!slab && kmem_reclaim() + pmm_zero_drain() > 0)
+            slab = kmem_slab_create(cache);
+
+        if (!slab)
+            return NULL;
+
+        kmem_slab_push(&cache->partial_slabs, slab);
+    }
+
+    uint16_t index = slab->free[--slab->free_count];
+    if (slab->free_count == 0) {
+        kmem_slab_remove(&cache->partial_slabs, slab);
+        kmem_slab_push(&cache->full_slabs, slab);
+    }
+
+    ++cache->stats.active_objects;
+    return slab->objects + index * cache->object_size;
+}
+
+void kmem_cache_free(struct kmem_cache* cache, void* object) {
+    if (!object)
+        return;
+
+    struct kmem_slab* slab = (struct kmem_slab*) PAGE_ALIGN_BACKWARD((uintptr_t) object);
+    assert(slab->cache == cache);
+
+    size_t offset = (uint8_t*) object - slab->objects;
+    assert(IS_ALIGNED_TO(offset, cache->object_size));
+    size_t index = offset / cache->object_size;
+    assert(index < cache->objects_per_slab && slab->free_count < cache->objects_per_slab);
+
+    bool was_full = slab->free_count == 0;
+    slab->free[slab->free_count++] = index;
+    --cache->stats.active_objects;
+
+    if (slab->free_count == cache->objects_per_slab) {
+        kmem_slab_remove(was_full ? &cache->full_slabs : &cache->partial_slabs, slab);
+        if (cache->stats.empty_slabs < KMEM_MAX_EMPTY_SLABS) {
+            kmem_slab_push(&cache->empty_slabs, slab);
+            ++cache->stats.empty_slabs;
+        } else {
+            kmem_slab_release(cache, slab);
+        }
+    } else if (was_full) {
+        kmem_slab_remove(&cache->full_slabs, slab);
+        kmem_slab_push(&cache->partial_slabs, slab);
+    }
+}
+
+size_t kmem_cache_reclaim(struct kmem_cache* cache) {
+    size_t pages = 0;
+    while (cache->empty_slabs) {
+        struct kmem_slab* slab = cache->empty_slabs;
+        kmem_slab_remove(&cache->empty_slabs, slab);
+        kmem_slab_release(cache, slab);
+        ++pages;
+    }
+
+    cache->stats.empty_slabs = 0;
+    return pages;
+}
+
+size_t kmem_reclaim(void) {
+    size_t pages = 0;
+    for (struct kmem_cache* cache = KMEM_CACHES; cache; cache = cache->next)
+        pages += kmem_cache_reclaim(cache);
+    return pages;
+}
+
+void kmem_cache_get_stats(const struct kmem_cache* cache, struct kmem_cache_stats* stats) {
+    *stats = cache->stats;
+}
+
+void kmem_print_stats(void) {
+    console_print("cache           size objs active slabs empty     hits   misses\n");
+    for (struct kmem_cache* cache = KMEM_CACHES; cache; cache = cache->next) {
+        console_print(cache->name);
+        for (size_t i = strlen(cache->name); i < KMEM_CACHE_NAME_SIZE; ++i)
+            console_putchar(' ');
+
+        console_printf(
+            "%4zu %4zu %6u %5u %5u %8u %8u\n",
+            cache->object_size,
+            cache->objects_per_slab,
+            cache->stats.active_objects,
+            cache->stats.slabs,
+            cache->stats.empty_slabs,
+            cache->stats.hits,
+            cache->stats.misses
+        );
+    }
+}
@@ -0,0 +1,160 @@
+#include "memory/vaddr.h"
+#include "memory/address_range.h"
+#include "memory/kernel_layout.h"
+#include "memory/page_table.h"
+#include "memory/slab.h"
+
+#include "core/init.h"
+
+#include "utility/containers/rbtree.h"
+#include "utility/container_of.h"
+
+#include "debug/assert.h"
+#include "debug/log.h"
+
+#include <stdint.h>
+
+// A free region of virtual address space, which is part of both trees.
+struct vaddr_region {
+    struct address_range range;
+
+    // Node in the tree ordered by base address.
+    struct rb_node base_node;
+
+    // Node in the tree ordered by size. Regions of the same size are ordered by base address.
+    struct rb_node size_node;
+};
+
+static struct {
+    struct rb_tree by_base;
+    struct rb_tree by_size;
+
+    // Cache from which the regions are allocated.
+    struct kmem_cache* region_cache;
+
+    // The total number of free bytes.
+    size_t free_size;
+} VADDR_STATE;
+
+static int vaddr_base_cmp(struct rb_node* lhs, struct rb_node* rhs) {
+    return address_range_base_cmp(
+        &CONTAINER_OF(struct vaddr_region, base_node, lhs)->range,
+        &CONTAINER_OF(struct vaddr_region, base_node, rhs)->range
+    );
+}
+
+static int vaddr_size_cmp(struct rb_node* lhs, struct rb_node* rhs) {
+    struct address_range* lhs_range = &CONTAINER_OF(struct vaddr_region, size_node, lhs)->range;
+    struct address_range* rhs_range = &CONTAINER_OF(struct vaddr_region, size_node, rhs)->range;
+    int order = address_range_size_cmp(lhs_range, rhs_range);
+    return order != 0 ? order : address_range_base_cmp(lhs_range, rhs_range);
+}
+
+static int vaddr_address_cmp(void* address, struct rb_node* node) {
+    return address_range_address_cmp(address, &CONTAINER_OF(struct vaddr_region, base_node, node)->range);
+}
+
+// Compares a size with a region such that the lower bound is the smallest region of at least that size.
+static int vaddr_fit_cmp(void* size, struct rb_node* node) {
+    return *(size_t*) size <= CONTAINER_OF(struct vaddr_region, size_node, node)->range.size ? -1 : 1;
+}
+
+// Find the free region which contains `address`, or NULL if the address is not free.
+static struct vaddr_region* vaddr_find(uintptr_t address) {
+    struct rb_node* node = rb_find_by(&VADDR_STATE.by_base, vaddr_address_cmp, (void*) address);
+    return node ? CONTAINER_OF(struct vaddr_region, base_node, node) : NULL;
+}
+
+static void vaddr_remove(struct vaddr_region* region) {
+    rb_delete(&VADDR_STATE.by_base, &region->base_node);
+    rb_delete(&VADDR_STATE.by_size, &region->size_node);
+    kmem_cache_free(VADDR_STATE.region_cache, region);
+}
+
+// Change the range of a region. The new range must not change the order of the region relative to the
+// other regions in the base tree, so only the size tree is updated.
+static void vaddr_resize(struct vaddr_region* region, uintptr_t base, uintptr_t size) {
+    rb_delete(&VADDR_STATE.by_size, &region->size_node);
+    region->range.base = base;
+    region->range.size = size;
+    rb_insert(&VADDR_STATE.by_size, &region->size_node);
+}
+
+__init void vaddr_init(void) {
+    rb_init(&VADDR_STATE.by_base, vaddr_base_cmp);
+    rb_init(&VADDR_STATE.by_size, vaddr_size_cmp);
+    VADDR_STATE.region_cache = kmem_cache_create("vaddr_region", sizeof(struct vaddr_region), 0, NULL);
+    assert(VADDR_STATE.region_cache);
+    VADDR_STATE.free_size = 0;
+
+    vaddr_free((void*) KERNEL_VADDR_START, KERNEL_VADDR_END - KERNEL_VADDR_START);
+}
+
+void* vaddr_alloc(size_t size) {
+    assert(size > 0 && IS_PAGE_ALIGNED(size));
+
+    struct rb_node* node = rb_lower_bound_by(&VADDR_STATE.by_size, vaddr_fit_cmp, &size);
+    if (!node)
+        return NULL;
+
+    // Take the allocation from the start of the region. This keeps the region in the same place in the base tree.
+    struct vaddr_region* region = CONTAINER_OF(struct vaddr_region, size_node, node);
+    uintptr_t base = region->range.base;
+    if (region->range.size == size) {
+        vaddr_remove(region);
+    } else {
+        vaddr_resize(region, base + size, region->range.size - size);
+    }
+
+    VADDR_STATE.free_size -= size;
+    return (void*) base;
+}
+
+void vaddr_free(void* ptr, size_t size) {
+    uintptr_t base = (uintptr_t) ptr;
+    assert(size > 0 && IS_PAGE_ALIGNED(base) && IS_PAGE_ALIGNED(size));
+    assert(base >= KERNEL_VADDR_START && base + size <= KERNEL_VADDR_END && base + size > base);
+    assert(!vaddr_find(base) && !vaddr_find(base + size - 1));
+
+    struct vaddr_region* prev = base > KERNEL_VADDR_START ? vaddr_find(base - 1) : NULL;
+    struct vaddr_region* next = base + size < KERNEL_VADDR_END ? vaddr_find(base + size) : NULL;
+
+    VADDR_STATE.free_size += size;
+
+    if (prev && next) {
+        uintptr_t merged_size = prev->range.size + size + next->range.size;
+        vaddr_remove(next);
+        vaddr_resize(prev, prev->range.base, merged_size);
+    } else if (prev) {
+        vaddr_resize(prev, prev->range.base, prev->range.size + size);
+    } else if (next) {
+        vaddr_resize(next, base, next->range.size + size);
+    } else {
+        struct vaddr_region* region = kmem_cache_alloc(VADDR_STATE.region_cache);
+        if (!region) {
+            log_error("Out of memory while freeing virtual address range %p-%p", ptr, (void*) (base + size));
+            VADDR_STATE.free_size -= size;
+            return;
+        }
+
+        region->range.base = base;
+        region->range.size = size;
+        rb_insert(&VADDR_STATE.by_base, &region->base_node);
+        rb_insert(&VADDR_STATE.by_size, &region->size_node);
+    }
+}
+
+size_t vaddr_free_size(void) {
+    return VADDR_STATE.free_size;
+}
+
+size_t vaddr_largest_free(void) {
+    struct rb_node* node = VADDR_STATE.by_size.root;
+    if (!node)
+        return 0;
+
+    while (node->right)
+        node = node->right;
+
+    return CONTAINER_OF(struct vaddr_region, size_node, node)->range.size;
+}
@@ -0,0 +1,184 @@
+#include "memory/vm_region.h"
+#include "memory/vaddr.h"
+#include "memory/pmm.h"
+#include "memory/slab.h"
+#include "memory/page_table.h"
+#include "memory/memtag.h"
+
+#include "core/init.h"
+
+#include "utility/container_of.h"
+
+#include "debug/assert.h"
+#include "debug/log.h"
+#include "debug/console/console.h"
+
+#include <string.h>
+
+static struct {
+    struct vm_space kernel_space;
+
+    // Cache from which the regions of all address spaces are allocated.
+    struct kmem_cache* region_cache;
+} VM_STATE;
+
+static int vm_region_cmp(struct rb_node* lhs, struct rb_node* rhs) {
+    return address_range_base_cmp(
+        &CONTAINER_OF(struct vm_region, node, lhs)->range,
+        &CONTAINER_OF(struct vm_region, node, rhs)->range
+    );
+}
+
+static int vm_region_address_cmp(void* address, struct rb_node* node) {
+    return address_range_address_cmp(address, &CONTAINER_OF(struct vm_region, node, node)->range);
+}
+
+// Compares an address with a region such that the lower bound is the first region that ends after the address.
+// Because regions do not overlap, their ends are in the same order as their bases.
+static int vm_region_end_cmp(void* address, struct rb_node* node) {
+    struct address_range* range = &CONTAINER_OF(struct vm_region, node, node)->range;
+    return (uintptr_t) address < range->base + range->size ? -1 : 1;
+}
+
+__init void vm_init(void) {
+    VM_STATE.region_cache = kmem_cache_create("vm_region", sizeof(struct vm_region), 0, NULL);
+    assert(VM_STATE.region_cache);
+    vm_space_init(&VM_STATE.kernel_space);
+}
+
+struct vm_space* vm_kernel_space(void) {
+    return &VM_STATE.kernel_space;
+}
+
+void vm_space_init(struct vm_space* space) {
+    rb_init(&space->regions, vm_region_cmp);
+    space->unhandled_faults = 0;
+}
+
+struct vm_region* vm_region_create(struct vm_space* space, const char* name, uintptr_t base, size_t size, enum vmm_map_flags flags) {
+    assert(size > 0 && IS_PAGE_ALIGNED(base) && IS_PAGE_ALIGNED(size));
+    assert(base + size > base);
+
+    // The first region that ends after `base` must start at or after the end of the new region.
+    struct rb_node* next = rb_lower_bound_by(&space->regions, vm_region_end_cmp, (void*) base);
+    assert(!next || CONTAINER_OF(struct vm_region, node, next)->range.base >= base + size);
+
+    struct vm_region* region = kmem_cache_alloc(VM_STATE.region_cache);
+    if (!region)
+        return NULL;
+
+    region->range.base = base;
+    region->range.size = size;
+    region->flags = flags & ~VMM_MAP_OVERWRITE;
+    region->faults = 0;
+
+    size_t name_len = strlen(name);
+    if (name_len >= VM_REGION_NAME_SIZE)
+        name_len = VM_REGION_NAME_SIZE - 1;
+    memcpy(region->name, name, name_len);
+    region->name[name_len] = '\0';
+
+    rb_insert(&space->regions, &region->node);
+    return region;
+}
+
+void vm_region_destroy(struct vm_space* space, struct vm_region* region) {
+    uint8_t* base = (uint8_t*) region->range.base;
+    size_t pages = PAGE_INDEX(region->range.size);
+
+    // Only the pages that were touched are mapped, so the others are skipped. Pages may be shared with
+    // cloned address spaces, so they are only freed once nothing else refers to them.
+    for (size_t i = 0; i < pages; ++i) {
+        void* physical;
+        if (vmm_translate(base + i * PAGE_SIZE, &physical) == VMM_SUCCESS && pmm_unref_page(PAGE_INDEX((uintptr_t) physical)))
+            memtag_remove(MEMTAG_REGION, 1);
+    }
+
+    vmm_unmap_range(base, pages);
+
+    rb_delete(&space->regions, &region->node);
+    kmem_cache_free(VM_STATE.region_cache, region);
+}
+
+struct vm_region* vm_region_alloc_kernel(const char* name, size_t size, enum vmm_map_flags flags) {
+    void* base = vaddr_alloc(size);
+    if (!base)
+        return NULL;
+
+    struct vm_region* region = vm_region_create(&VM_STATE.kernel_space, name, (uintptr_t) base, size, flags);
+    if (!region)
+        vaddr_free(base, size);
+
+    return region;
+}
+
+void vm_region_free_kernel(struct vm_region* region) {
+    void* base = (void*) region->range.base;
+    size_t size = region->range.size;
+    vm_region_destroy(&VM_STATE.kernel_space, region);
+    vaddr_free(base, size);
+}
+
+struct vm_region* vm_region_find(struct vm_space* space, uintptr_t address) {
+    struct rb_node* node = rb_find_by(&space->regions, vm_region_address_cmp, (void*) address);
+    return node ? CONTAINER_OF(struct vm_region, node, node) : NULL;
+}
+
+bool vm_handle_page_fault(struct vm_space* space, uintptr_t address, uint32_t status) {
+    // A protection violation means the page is mapped already. The only one that is resolved is a write
+    // to a page shared with a cloned address space.
+    if (status & VM_FAULT_PRESENT)
+        return (status & VM_FAULT_WRITE) && vmm_handle_cow_fault((void*) address);
+
+    struct vm_region* region = vm_region_find(space, address);
+    if (!region) {
+        ++space->unhandled_faults;
+        return false;
+    }
+
+    if ((status & VM_FAULT_WRITE) && !(region->flags & VMM_MAP_WRITABLE))
+        return false;
+
+    if ((status & VM_FAULT_USER) && !(region->flags & VMM_MAP_USER))
+        return false;
+
+    intptr_t page = pmm_alloc_zeroed();
+    if (PMM_ALLOC_FAILED(page)) {
+        log_error("Out of memory while handling a page fault in region '%s'", region->name);
+        return false;
+    }
+
+    void* virtual = (void*) PAGE_ALIGN_BACKWARD(address);
+    if (vmm_map_page(virtual, (void*) (page << PAGE_OFFSET_BITS), region->flags) != VMM_SUCCESS) {
+        log_error("Failed to map page %p in region '%s'", virtual, region->name);
+        pmm_free(page);
+        return false;
+    }
+
+    ++region->faults;
+    memtag_add(MEMTAG_REGION, 1);
+    return true;
+}
+
+void vm_space_print_stats(struct vm_space* space) {
+    console_print("region          start    end        pages resident\n");
+
+    struct rb_iterator it;
+    rb_iterator_init(&it, &space->regions);
+    while (rb_iterator_next(&it)) {
+        struct vm_region* region = CONTAINER_OF(struct vm_region, node, it.node);
+        console_print(region->name);
+        for (size_t i = strlen(region->name); i < VM_REGION_NAME_SIZE; ++i)
+            console_putchar(' ');
+
+        console_printf(
+            "%08X %08X %6u %8u\n",
+            region->range.base,
+            region->range.base + region->range.size,
+            PAGE_INDEX(region->range.size),
+            region->faults
+        );
+    }
+
+    console_printf("unhandled faults: %u\n", space->unhandled_faults);
+}
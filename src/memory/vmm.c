@@ -1,15 +1,76 @@
 #include "memory/vmm.h"
 #include "memory/pmm.h"
+#include "memory/heap.h"
 #include "memory/kernel_layout.h"
+#include "memory/physmap.h"
+#include "memory/memtag.h"
+
+#include "core/cpu.h"
+#include "core/cpu_dispatch.h"
+#include "core/init.h"
 
 #include "debug/log.h"
 #include "debug/assert.h"
 
 #include <stdbool.h>
+#include <string.h>
+
+// When the TLB entries of more than this number of pages need to be invalidated at once, the entire TLB
+// is flushed instead. At that point a flush loses little, as the TLB holds no more entries than this.
+#define VMM_TLB_FLUSH_THRESHOLD (VMM_TLB_ENTRIES)
 
 static struct page_directory VMM_KERNEL_PAGE_DIR;
 static struct page_table VMM_KERNEL_PAGE_TABLE;
 
+// Page table for the temporary mapping area. This is static so that temporary mappings never need
+// to allocate memory.
+static struct page_table VMM_TEMP_PAGE_TABLE;
+
+// Slots in the temporary mapping area. Every user of the area has its own slot, so that they do not
+// overwrite each other's mappings.
+enum vmm_temp_slot {
+    VMM_TEMP_SLOT_ZERO,
+    VMM_TEMP_SLOT_COPY,
+    VMM_TEMP_SLOT_DIRECTORY,
+    VMM_TEMP_SLOT_TABLE,
+    VMM_TEMP_SLOT_SYNC,
+};
+
+// The maximum number of page directories that can exist at the same time, including the kernel's own.
+#define VMM_MAX_DIRECTORIES (16U)
+
+// The number of page directory entries in the user part of the address space.
+#define VMM_USER_PAGE_TABLES (PAGE_DIR_INDEX(KERNEL_VIRTUAL_START))
+
+// A page directory, and for each of its user page tables the number of entries that are present.
+struct vmm_directory {
+    uintptr_t page;
+    uint16_t* user_table_used;
+};
+
+static struct vmm_tlb_stats VMM_TLB_STATS;
+static struct vmm_cow_stats VMM_COW_STATS;
+
+// For every page table, the number of entries that are present. A page table is freed when this drops to
+// zero, unless it is one of the static page tables. The kernel page tables are shared by all page directories,
+// and so are their counts. Every page directory has its own counts for the user part, and
+// `VMM_USER_TABLE_USED` points to those of the current one. See `vmm_page_table_used`.
+// Note: The user part of `VMM_KERNEL_TABLE_USED` holds the counts of the kernel's own page directory.
+static uint16_t VMM_KERNEL_TABLE_USED[PAGE_DIR_ENTRY_COUNT];
+static uint16_t* VMM_USER_TABLE_USED = VMM_KERNEL_TABLE_USED;
+
+// The number of physical pages accessible through the physical memory map.
+static size_t VMM_PHYSMAP_PAGES = 0;
+
+// Whether kernel pages are mapped as global pages, see `vmm_init_global_pages`.
+static bool VMM_GLOBAL_PAGES = false;
+
+// All page directories, by physical page index. They share the page tables of the kernel part, so an
+// entry of the kernel part is written to every one of them, see `vmm_set_kernel_pde`. This includes clearing
+// the entry of a kernel page table that is freed.
+static struct vmm_directory VMM_DIRECTORIES[VMM_MAX_DIRECTORIES];
+static size_t VMM_DIRECTORY_COUNT = 0;
+
 __attribute__((section(".bootstrap.text")))
 struct page_directory* vmm_bootstrap(void) {
     // Get the physical address of the page dir and kernel page table
@@ -62,15 +123,162 @@ struct page_directory* vmm_bootstrap(void) {
     return pd;
 }
 
-void vmm_unmap_identity(void) {
+// Flush the entire TLB. Reloading CR3 leaves global pages in the TLB, so if `global` is set and global
+// pages are in use, those are dropped by toggling CR4.PGE instead.
+static void vmm_flush_tlb(bool global) {
+    if (global && VMM_GLOBAL_PAGES) {
+        uint32_t cr4 = cpu_read_cr4();
+        cpu_write_cr4(cr4 & ~CPU_CR4_PGE);
+        cpu_write_cr4(cr4);
+        ++VMM_TLB_STATS.global_flushes;
+    } else {
+        pt_invalidate_tlb();
+    }
+
+    ++VMM_TLB_STATS.full_flushes;
+}
+
+// Check whether a page at `vaddr` should be mapped as a global page.
+static bool vmm_is_global(uintptr_t vaddr) {
+    return VMM_GLOBAL_PAGES && vaddr >= KERNEL_VIRTUAL_START;
+}
+
+__init void vmm_unmap_identity(void) {
     VMM_KERNEL_PAGE_DIR.entries[0] = (struct page_dir_entry){};
-    pt_invalidate_tlb();
+    vmm_flush_tlb(false);
+
+    // The kernel page table was filled by `vmm_bootstrap`, before entries were counted.
+    size_t pdi = PAGE_DIR_INDEX(KERNEL_VIRTUAL_START);
+    for (size_t i = 0; i < PAGE_TABLE_ENTRY_COUNT; ++i) {
+        if (VMM_KERNEL_PAGE_TABLE.entries[i].present)
+            ++VMM_KERNEL_TABLE_USED[pdi];
+    }
+
+    VMM_DIRECTORIES[VMM_DIRECTORY_COUNT++] = (struct vmm_directory){
+        .page = PAGE_INDEX((uintptr_t) KERNEL_VIRTUAL_TO_PHYSICAL(&VMM_KERNEL_PAGE_DIR)),
+        .user_table_used = VMM_KERNEL_TABLE_USED,
+    };
+}
+
+__init void vmm_init_global_pages(void) {
+    if (!cpu_has_feature(CPU_FEATURE_PGE)) {
+        log_info("Global pages are not supported");
+        return;
+    }
+
+    // The kernel page table was also used for the identity mapping, which must not become global.
+    assert(!VMM_KERNEL_PAGE_DIR.entries[0].present);
+    for (size_t i = 0; i < PAGE_TABLE_ENTRY_COUNT; ++i) {
+        if (VMM_KERNEL_PAGE_TABLE.entries[i].present)
+            VMM_KERNEL_PAGE_TABLE.entries[i].global = true;
+    }
+
+    // Enabling global pages flushes the TLB.
+    cpu_write_cr4(cpu_read_cr4() | CPU_CR4_PGE);
+    VMM_GLOBAL_PAGES = true;
+}
+
+static void vmm_invalidate_page(void* virtual) {
+    CPU_DISPATCH.invalidate_page(virtual);
+    ++VMM_TLB_STATS.invlpg;
+}
+
+// Invalidate the TLB entries of `pages` pages starting at `vaddr`, either one by one or by flushing
+// the entire TLB, whichever is cheaper.
+static void vmm_invalidate_range(uintptr_t vaddr, size_t pages) {
+    if (pages > VMM_TLB_FLUSH_THRESHOLD) {
+        vmm_flush_tlb(vmm_is_global(vaddr + (pages - 1) * PAGE_SIZE));
+        return;
+    }
+
+    for (size_t i = 0; i < pages; ++i) {
+        vmm_invalidate_page((void*) (vaddr + i * PAGE_SIZE));
+    }
 }
 
 struct vmm_recursive_page_table* vmm_current_page_table() {
     return (struct vmm_recursive_page_table*) (VMM_RECUSIVE_PAGE_DIR_INDEX * PAGE_TABLE_ENTRY_COUNT * PAGE_SIZE);
 }
 
+// Check whether the page table at page directory index `pdi` is one of the static page tables, of the kernel
+// image and of the temporary mapping area.
+static bool vmm_page_table_is_pinned(size_t pdi) {
+    return pdi == PAGE_DIR_INDEX(KERNEL_VIRTUAL_START) || pdi == PAGE_DIR_INDEX(KERNEL_TEMP_MAP_START);
+}
+
+static void vmm_set_kernel_pde(struct vmm_recursive_page_table* rpt, size_t pdi, struct page_dir_entry pde);
+
+// Return the count of present entries of the page table at page directory index `pdi` in the current
+// page directory.
+static uint16_t* vmm_page_table_used(size_t pdi) {
+    if (pdi < VMM_USER_PAGE_TABLES)
+        return &VMM_USER_TABLE_USED[pdi];
+    return &VMM_KERNEL_TABLE_USED[pdi];
+}
+
+// Make sure that the page table for page directory index `pdi` is present, and allocate it if not.
+static enum vmm_result vmm_ensure_page_table(struct vmm_recursive_page_table* rpt, size_t pdi) {
+    struct page_dir_entry* pde = &rpt->page_directory.entries[pdi];
+    if (pde->present)
+        return pde->is_huge_page ? VMM_HUGE_PAGE : VMM_SUCCESS;
+
+    // No page table available, so allocate one. The recursive mapping of a page table is invalidated
+    // when the page table is freed, so it is not cached here.
+    intptr_t page_table_page = pmm_alloc_zeroed();
+    if (page_table_page < 0)
+        return VMM_OUT_OF_PHYSICAL_MEMORY;
+
+    // Access is restricted by the page table entries, so the directory entry allows everything. User
+    // access is never allowed in the kernel part of the address space.
+    struct page_dir_entry entry = {
+        .present = true,
+        .write_enable = true,
+        .user = pdi < PAGE_DIR_INDEX(KERNEL_VIRTUAL_START),
+        .page_table_address = page_table_page,
+    };
+
+    if (pdi < PAGE_DIR_INDEX(KERNEL_VIRTUAL_START)) {
+        *pde = entry;
+    } else {
+        vmm_set_kernel_pde(rpt, pdi, entry);
+    }
+
+    *vmm_page_table_used(pdi) = 0;
+    memtag_add(MEMTAG_PAGE_TABLE, 1);
+
+    return VMM_SUCCESS;
+}
+
+// Account for `count` entries of the page table at page directory index `pdi` becoming present.
+static void vmm_page_table_add_used(size_t pdi, size_t count) {
+    uint16_t* used = vmm_page_table_used(pdi);
+    *used += count;
+    assert(*used <= PAGE_TABLE_ENTRY_COUNT);
+}
+
+// Account for `count` entries of the page table at page directory index `pdi` being cleared, and
+// free the page table if it no longer has any entries. Kernel page tables are shared, so their entry is
+// cleared in every page directory before they are freed.
+static void vmm_page_table_remove_used(struct vmm_recursive_page_table* rpt, size_t pdi, size_t count) {
+    uint16_t* used = vmm_page_table_used(pdi);
+    assert(*used >= count);
+    *used -= count;
+    if (*used > 0 || count == 0 || vmm_page_table_is_pinned(pdi))
+        return;
+
+    struct page_dir_entry* pde = &rpt->page_directory.entries[pdi];
+    uintptr_t page_table_page = pde->page_table_address;
+    if (pdi < PAGE_DIR_INDEX(KERNEL_VIRTUAL_START)) {
+        *pde = (struct page_dir_entry){};
+    } else {
+        vmm_set_kernel_pde(rpt, pdi, (struct page_dir_entry){});
+    }
+    vmm_invalidate_page(&rpt->page_tables[pdi]);
+    pmm_free(page_table_page);
+    memtag_remove(MEMTAG_PAGE_TABLE, 1);
+    ++VMM_TLB_STATS.page_tables_freed;
+}
+
 enum vmm_result vmm_map_page(void* virtual, void* physical, enum vmm_map_flags flags) {
     uintptr_t vaddr = (uintptr_t) virtual;
     assert(IS_PAGE_ALIGNED(vaddr));
@@ -83,35 +291,85 @@ enum vmm_result vmm_map_page(void* virtual, void* physical, enum vmm_map_flags f
 
     struct vmm_recursive_page_table* rpt = vmm_current_page_table();
 
-    struct page_dir_entry* pde = &rpt->page_directory.entries[pdi];
-    if (!pde->present) {
-        // No page table available, so allocate one.
-
-        intptr_t page_table_page = pmm_alloc();
-        if (page_table_page < 0)
-            return VMM_OUT_OF_PHYSICAL_MEMORY;
-
-        *pde = (struct page_dir_entry){
-            .present = true,
-            .page_table_address = page_table_page,
-        };
-    }
+    enum vmm_result result = vmm_ensure_page_table(rpt, pdi);
+    if (result != VMM_SUCCESS)
+        return result;
 
     struct page_table_entry* pte = &rpt->page_tables[pdi].entries[pti];
     if (pte->present && (flags & VMM_MAP_OVERWRITE) == 0) {
         // Page was previously mapped.
         return VMM_ALREADY_MAPPED;
+    } else if (!pte->present) {
+        vmm_page_table_add_used(pdi, 1);
     }
 
     *pte = (struct page_table_entry){
         .present = true,
         .write_enable = (flags & VMM_MAP_WRITABLE) != 0,
         .user = (flags & VMM_MAP_USER) != 0,
+        .global = vmm_is_global(vaddr),
         .page_address = PAGE_INDEX(paddr)
     };
 
     if (flags & VMM_MAP_OVERWRITE) {
-        pt_invalidate_address(virtual);
+        vmm_invalidate_page(virtual);
+    }
+
+    return VMM_SUCCESS;
+}
+
+enum vmm_result vmm_map_range(void* virtual, void* physical, size_t pages, enum vmm_map_flags flags) {
+    uintptr_t vaddr = (uintptr_t) virtual;
+    assert(IS_PAGE_ALIGNED(vaddr));
+
+    uintptr_t paddr = (uintptr_t) physical;
+    assert(IS_PAGE_ALIGNED(paddr));
+
+    struct vmm_recursive_page_table* rpt = vmm_current_page_table();
+    struct page_table* pt = NULL;
+    bool overwritten = false;
+
+    for (size_t i = 0; i < pages; ++i) {
+        uintptr_t addr = vaddr + i * PAGE_SIZE;
+        size_t pti = PAGE_TABLE_INDEX(addr);
+
+        // Only look at the page directory when crossing into the next page table.
+        if (!pt || pti == 0) {
+            size_t pdi = PAGE_DIR_INDEX(addr);
+            enum vmm_result result = vmm_ensure_page_table(rpt, pdi);
+            if (result != VMM_SUCCESS) {
+                vmm_unmap_range(virtual, i);
+                return result;
+            }
+
+            pt = &rpt->page_tables[pdi];
+        }
+
+        struct page_table_entry* pte = &pt->entries[pti];
+        if (pte->present) {
+            if ((flags & VMM_MAP_OVERWRITE) == 0) {
+                vmm_unmap_range(virtual, i);
+                return VMM_ALREADY_MAPPED;
+            }
+
+            overwritten = true;
+        } else {
+            vmm_page_table_add_used(PAGE_DIR_INDEX(addr), 1);
+        }
+
+        *pte = (struct page_table_entry){
+            .present = true,
+            .write_enable = (flags & VMM_MAP_WRITABLE) != 0,
+            .user = (flags & VMM_MAP_USER) != 0,
+            .global = vmm_is_global(addr),
+            .page_address = PAGE_INDEX(paddr) + i
+        };
+    }
+
+    // Pages which were not present before are not cached in the TLB, so only overwritten mappings
+    // need to be invalidated.
+    if (overwritten) {
+        vmm_invalidate_range(vaddr, pages);
     }
 
     return VMM_SUCCESS;
@@ -129,6 +387,9 @@ enum vmm_result vmm_unmap_page(void* virtual) {
     if (!pde->present) {
         log_warn("Tried to unmap %p which was not mapped", virtual);
         return VMM_NOT_MAPPED;
+    } else if (pde->is_huge_page) {
+        log_warn("Tried to unmap %p which is part of a 4 MiB page", virtual);
+        return VMM_HUGE_PAGE;
     }
 
     // Check if the page is mapped at all
@@ -140,12 +401,69 @@ enum vmm_result vmm_unmap_page(void* virtual) {
 
     // remove the page from the table
     *pte = (struct page_table_entry){};
-    pt_invalidate_address(virtual);
+    vmm_invalidate_page(virtual);
+    vmm_page_table_remove_used(rpt, pdi, 1);
 
-    // TODO: Maybe free page table if it's empty
     return VMM_SUCCESS;
 }
 
+enum vmm_result vmm_unmap_range(void* virtual, size_t pages) {
+    uintptr_t vaddr = (uintptr_t) virtual;
+    assert(IS_PAGE_ALIGNED(vaddr));
+
+    struct vmm_recursive_page_table* rpt = vmm_current_page_table();
+    enum vmm_result result = VMM_SUCCESS;
+    struct page_table* pt = NULL;
+    size_t pdi = 0;
+
+    // The number of entries cleared in the current page table.
+    size_t cleared = 0;
+
+    for (size_t i = 0; i < pages; ++i) {
+        uintptr_t addr = vaddr + i * PAGE_SIZE;
+        size_t pti = PAGE_TABLE_INDEX(addr);
+
+        // Only look at the page directory when crossing into the next page table.
+        if (i == 0 || pti == 0) {
+            if (pt) {
+                vmm_page_table_remove_used(rpt, pdi, cleared);
+                cleared = 0;
+            }
+
+            pdi = PAGE_DIR_INDEX(addr);
+            struct page_dir_entry* pde = &rpt->page_directory.entries[pdi];
+            pt = pde->present && !pde->is_huge_page ? &rpt->page_tables[pdi] : NULL;
+            if (pde->present && pde->is_huge_page) {
+                result = VMM_HUGE_PAGE;
+            }
+        }
+
+        struct page_table_entry* pte = pt ? &pt->entries[pti] : NULL;
+        if (!pte || !pte->present) {
+            if (result != VMM_HUGE_PAGE) {
+                result = VMM_NOT_MAPPED;
+            }
+            continue;
+        }
+
+        *pte = (struct page_table_entry){};
+        ++cleared;
+    }
+
+    if (pt) {
+        vmm_page_table_remove_used(rpt, pdi, cleared);
+    }
+
+    if (result == VMM_NOT_MAPPED) {
+        log_warn("Tried to unmap %p-%p which was not entirely mapped", virtual, (void*) (vaddr + pages * PAGE_SIZE));
+    } else if (result == VMM_HUGE_PAGE) {
+        log_warn("Tried to unmap %p-%p which overlaps a 4 MiB page", virtual, (void*) (vaddr + pages * PAGE_SIZE));
+    }
+
+    vmm_invalidate_range(vaddr, pages);
+    return result;
+}
+
 enum vmm_result vmm_translate(void* virtual, void** physical) {
     uintptr_t vaddr = (uintptr_t) virtual;
     size_t pdi = PAGE_DIR_INDEX(vaddr);
@@ -156,6 +474,9 @@ enum vmm_result vmm_translate(void* virtual, void** physical) {
     struct page_dir_entry* pde = &rpt->page_directory.entries[pdi];
     if (!pde->present) {
         return VMM_NOT_MAPPED;
+    } else if (pde->is_huge_page) {
+        *physical = (void*) ((pde->page_table_address << PAGE_OFFSET_BITS) | HUGE_PAGE_OFFSET(vaddr));
+        return VMM_SUCCESS;
     }
 
     struct page_table_entry* pte = &rpt->page_tables[pdi].entries[pti];
@@ -167,3 +488,317 @@ enum vmm_result vmm_translate(void* virtual, void** physical) {
 
     return VMM_SUCCESS;
 }
+
+void vmm_get_tlb_stats(struct vmm_tlb_stats* stats) {
+    *stats = VMM_TLB_STATS;
+}
+
+__init void vmm_init_physmap(size_t pages) {
+    size_t limit = PAGE_INDEX(KERNEL_PHYSMAP_END - KERNEL_VIRTUAL_START);
+    if (pages > limit) {
+        log_warn("Only the first %zu MiB of physical memory is mapped in the physical memory map", limit >> 8);
+        pages = limit;
+    }
+
+    size_t size = pages * PAGE_SIZE;
+
+    struct vmm_recursive_page_table* rpt = vmm_current_page_table();
+    bool pse = cpu_has_feature(CPU_FEATURE_PSE);
+
+    if (pse) {
+        cpu_write_cr4(cpu_read_cr4() | CPU_CR4_PSE);
+        size = HUGE_PAGE_ALIGN_FORWARD(size);
+    } else {
+        log_info("4 MiB pages are not supported, mapping physical memory with page tables");
+        size = PAGE_ALIGN_BACKWARD(size);
+    }
+
+    for (uintptr_t paddr = 0; paddr < size; paddr += HUGE_PAGE_SIZE) {
+        uintptr_t vaddr = KERNEL_VIRTUAL_START + paddr;
+        size_t pdi = PAGE_DIR_INDEX(vaddr);
+        struct page_dir_entry* pde = &rpt->page_directory.entries[pdi];
+
+        if (pse) {
+            // The only page table that can be present here is the static kernel page table, which
+            // is no longer used after this.
+            assert(!pde->present || vmm_page_table_is_pinned(pdi));
+
+            *pde = (struct page_dir_entry){
+                .present = true,
+                .write_enable = true,
+                .is_huge_page = true,
+                .global = VMM_GLOBAL_PAGES,
+                .page_table_address = PAGE_INDEX(paddr),
+            };
+            continue;
+        }
+
+        size_t chunk_pages = size - paddr < HUGE_PAGE_SIZE ? PAGE_INDEX(size - paddr) : PAGE_TABLE_ENTRY_COUNT;
+        if (vmm_page_table_is_pinned(pdi)) {
+            // The kernel page table already maps the kernel image, which must be left intact.
+            for (size_t i = 0; i < chunk_pages; ++i) {
+                enum vmm_result result = vmm_map_page((void*) (vaddr + i * PAGE_SIZE), (void*) (paddr + i * PAGE_SIZE), VMM_MAP_WRITABLE);
+                assert(result == VMM_SUCCESS || result == VMM_ALREADY_MAPPED);
+            }
+        } else {
+            assert(vmm_map_range((void*) vaddr, (void*) paddr, chunk_pages, VMM_MAP_WRITABLE) == VMM_SUCCESS);
+        }
+    }
+
+    if (pse) {
+        vmm_flush_tlb(true);
+    }
+
+    VMM_PHYSMAP_PAGES = pages;
+    log_info("Mapped %zu MiB of physical memory at %p", size >> 20, (void*) KERNEL_VIRTUAL_START);
+}
+
+size_t vmm_release_boot_page_table(void) {
+    if (!VMM_KERNEL_PAGE_DIR.entries[PAGE_DIR_INDEX(KERNEL_VIRTUAL_START)].is_huge_page)
+        return 0;
+
+    pmm_free(PAGE_INDEX((uintptr_t) KERNEL_VIRTUAL_TO_PHYSICAL(&VMM_KERNEL_PAGE_TABLE)));
+    return 1;
+}
+
+size_t vmm_physmap_pages(void) {
+    return VMM_PHYSMAP_PAGES;
+}
+
+// Map the physical page with index `page` at `slot` in the temporary mapping area, and return its address.
+// The page table of the area is installed on first use.
+static void* vmm_temp_map(enum vmm_temp_slot slot, uintptr_t page) {
+    struct vmm_recursive_page_table* rpt = vmm_current_page_table();
+    size_t pdi = PAGE_DIR_INDEX(KERNEL_TEMP_MAP_START);
+    if (!rpt->page_directory.entries[pdi].present) {
+        vmm_set_kernel_pde(rpt, pdi, (struct page_dir_entry){
+            .present = true,
+            .write_enable = true,
+            .page_table_address = PAGE_INDEX((uintptr_t) KERNEL_VIRTUAL_TO_PHYSICAL(&VMM_TEMP_PAGE_TABLE)),
+        });
+    }
+
+    void* window = (void*) (KERNEL_TEMP_MAP_START + slot * PAGE_SIZE);
+    struct page_table_entry* pte = &rpt->page_tables[pdi].entries[PAGE_TABLE_INDEX((uintptr_t) window)];
+    if (!pte->present)
+        vmm_page_table_add_used(pdi, 1);
+
+    *pte = (struct page_table_entry){
+        .present = true,
+        .write_enable = true,
+        .global = VMM_GLOBAL_PAGES,
+        .page_address = page,
+    };
+    vmm_invalidate_page(window);
+    return window;
+}
+
+// Return an address at which the physical page with index `page` can be accessed: in the physical memory
+// map if possible, and at `slot` in the temporary mapping area otherwise.
+static void* vmm_access_page(enum vmm_temp_slot slot, uintptr_t page) {
+    if (physmap_contains_page(page))
+        return phys_to_virt(page << PAGE_OFFSET_BITS);
+    return vmm_temp_map(slot, page);
+}
+
+// Set the entry at index `pdi` of the kernel part in every page directory. The current page directory is
+// written first, so that the others can be accessed through the temporary mapping area even if this
+// installs its page table.
+static void vmm_set_kernel_pde(struct vmm_recursive_page_table* rpt, size_t pdi, struct page_dir_entry pde) {
+    assert(pdi >= PAGE_DIR_INDEX(KERNEL_VIRTUAL_START) && pdi != VMM_RECUSIVE_PAGE_DIR_INDEX);
+    rpt->page_directory.entries[pdi] = pde;
+
+    uintptr_t current = rpt->page_directory.entries[VMM_RECUSIVE_PAGE_DIR_INDEX].page_table_address;
+    for (size_t i = 0; i < VMM_DIRECTORY_COUNT; ++i) {
+        if (VMM_DIRECTORIES[i].page == current)
+            continue;
+
+        struct page_directory* pd = vmm_access_page(VMM_TEMP_SLOT_SYNC, VMM_DIRECTORIES[i].page);
+        pd->entries[pdi] = pde;
+    }
+}
+
+// Return the index of the page directory with physical page index `directory` in `VMM_DIRECTORIES`, or
+// `VMM_DIRECTORY_COUNT` if it is not a known page directory.
+static size_t vmm_find_directory(uintptr_t directory) {
+    size_t i = 0;
+    while (i < VMM_DIRECTORY_COUNT && VMM_DIRECTORIES[i].page != directory)
+        ++i;
+    return i;
+}
+
+void vmm_zero_page(uintptr_t page) {
+    CPU_DISPATCH.zero_page(vmm_access_page(VMM_TEMP_SLOT_ZERO, page));
+}
+
+// Free the page tables of the user part of the page directory `pd`, and drop the references to the pages
+// mapped in them.
+static void vmm_release_user_tables(struct page_directory* pd) {
+    for (size_t pdi = 0; pdi < PAGE_DIR_INDEX(KERNEL_VIRTUAL_START); ++pdi) {
+        struct page_dir_entry* pde = &pd->entries[pdi];
+        if (!pde->present)
+            continue;
+
+        assert(!pde->is_huge_page);
+        struct page_table* pt = vmm_access_page(VMM_TEMP_SLOT_TABLE, pde->page_table_address);
+        for (size_t pti = 0; pti < PAGE_TABLE_ENTRY_COUNT; ++pti) {
+            if (pt->entries[pti].present && pmm_unref_page(pt->entries[pti].page_address))
+                memtag_remove(MEMTAG_REGION, 1);
+        }
+
+        pmm_free(pde->page_table_address);
+        memtag_remove(MEMTAG_PAGE_TABLE, 1);
+        *pde = (struct page_dir_entry){};
+    }
+}
+
+intptr_t vmm_clone_directory(void) {
+    if (VMM_DIRECTORY_COUNT == VMM_MAX_DIRECTORIES)
+        return -1;
+
+    // The user page tables of the clone have the same entries as the current ones.
+    uint16_t* user_table_used = kmalloc(VMM_USER_PAGE_TABLES * sizeof(uint16_t));
+    if (!user_table_used)
+        return -1;
+    memcpy(user_table_used, VMM_USER_TABLE_USED, VMM_USER_PAGE_TABLES * sizeof(uint16_t));
+
+    intptr_t pd_page = pmm_alloc_zeroed();
+    if (PMM_ALLOC_FAILED(pd_page)) {
+        kfree(user_table_used);
+        return pd_page;
+    }
+    memtag_add(MEMTAG_PAGE_TABLE, 1);
+
+    struct vmm_recursive_page_table* rpt = vmm_current_page_table();
+    struct page_directory* pd = vmm_access_page(VMM_TEMP_SLOT_DIRECTORY, pd_page);
+
+    // The user part of the address space gets its own page tables, which share the pages of the current ones.
+    for (size_t pdi = 0; pdi < PAGE_DIR_INDEX(KERNEL_VIRTUAL_START); ++pdi) {
+        struct page_dir_entry* pde = &rpt->page_directory.entries[pdi];
+        if (!pde->present)
+            continue;
+
+        intptr_t pt_page = pmm_alloc();
+        if (PMM_ALLOC_FAILED(pt_page)) {
+            // The pages that were already shared stay copy-on-write in the current page tables. The
+            // first write to them finds that they are no longer shared, and makes them writable again.
+            vmm_release_user_tables(pd);
+            pmm_free(pd_page);
+            memtag_remove(MEMTAG_PAGE_TABLE, 1);
+            kfree(user_table_used);
+            vmm_flush_tlb(false);
+            return pt_page;
+        }
+
+        memtag_add(MEMTAG_PAGE_TABLE, 1);
+        struct page_table* pt = &rpt->page_tables[pdi];
+        for (size_t pti = 0; pti < PAGE_TABLE_ENTRY_COUNT; ++pti) {
+            struct page_table_entry* pte = &pt->entries[pti];
+            if (!pte->present)
+                continue;
+
+            if (pte->write_enable) {
+                pte->write_enable = false;
+                pte->copy_on_write = true;
+            }
+
+            pmm_ref_page(pte->page_address);
+            ++VMM_COW_STATS.shared_pages;
+        }
+
+        memcpy(vmm_access_page(VMM_TEMP_SLOT_TABLE, pt_page), pt, PAGE_SIZE);
+        pd->entries[pdi] = *pde;
+        pd->entries[pdi].page_table_address = pt_page;
+    }
+
+    // The kernel part of the address space is shared. Entries created in it later are written to every
+    // page directory, so they stay the same.
+    for (size_t pdi = PAGE_DIR_INDEX(KERNEL_VIRTUAL_START); pdi < VMM_RECUSIVE_PAGE_DIR_INDEX; ++pdi) {
+        pd->entries[pdi] = rpt->page_directory.entries[pdi];
+    }
+
+    pd->entries[VMM_RECUSIVE_PAGE_DIR_INDEX] = (struct page_dir_entry){
+        .present = true,
+        .write_enable = true,
+        .page_table_address = pd_page,
+    };
+
+    // Writable pages in the current address space were made read-only. Those are all user pages, so
+    // global pages can stay.
+    vmm_flush_tlb(false);
+    ++VMM_COW_STATS.clones;
+
+    VMM_DIRECTORIES[VMM_DIRECTORY_COUNT++] = (struct vmm_directory){
+        .page = pd_page,
+        .user_table_used = user_table_used,
+    };
+
+    return pd_page;
+}
+
+void vmm_release_directory(uintptr_t directory) {
+    struct vmm_recursive_page_table* rpt = vmm_current_page_table();
+    assert(directory != rpt->page_directory.entries[VMM_RECUSIVE_PAGE_DIR_INDEX].page_table_address);
+
+    size_t index = vmm_find_directory(directory);
+    assert(index > 0 && index < VMM_DIRECTORY_COUNT);
+    kfree(VMM_DIRECTORIES[index].user_table_used);
+    VMM_DIRECTORIES[index] = VMM_DIRECTORIES[--VMM_DIRECTORY_COUNT];
+
+    vmm_release_user_tables(vmm_access_page(VMM_TEMP_SLOT_DIRECTORY, directory));
+    pmm_free(directory);
+    memtag_remove(MEMTAG_PAGE_TABLE, 1);
+}
+
+bool vmm_handle_cow_fault(void* virtual) {
+    uintptr_t vaddr = PAGE_ALIGN_BACKWARD((uintptr_t) virtual);
+    size_t pdi = PAGE_DIR_INDEX(vaddr);
+    struct vmm_recursive_page_table* rpt = vmm_current_page_table();
+
+    struct page_dir_entry* pde = &rpt->page_directory.entries[pdi];
+    if (!pde->present || pde->is_huge_page)
+        return false;
+
+    struct page_table_entry* pte = &rpt->page_tables[pdi].entries[PAGE_TABLE_INDEX(vaddr)];
+    if (!pte->present || !pte->copy_on_write)
+        return false;
+
+    uintptr_t page = pte->page_address;
+    if (pmm_page_refs(page) > 1) {
+        // Still shared, so this address space gets its own copy.
+        intptr_t copy = pmm_alloc();
+        if (PMM_ALLOC_FAILED(copy)) {
+            log_error("Out of memory while copying page %p", (void*) vaddr);
+            return false;
+        }
+
+        CPU_DISPATCH.copy_page(vmm_access_page(VMM_TEMP_SLOT_COPY, copy), (void*) vaddr);
+        pte->page_address = copy;
+        memtag_add(MEMTAG_REGION, 1);
+        if (pmm_unref_page(page))
+            memtag_remove(MEMTAG_REGION, 1);
+        ++VMM_COW_STATS.copied_pages;
+    } else {
+        // All other address spaces dropped the page, so it can be written in place.
+        ++VMM_COW_STATS.reused_pages;
+    }
+
+    pte->write_enable = true;
+    pte->copy_on_write = false;
+    vmm_invalidate_page((void*) vaddr);
+    return true;
+}
+
+void vmm_switch_directory(uintptr_t directory) {
+    size_t index = vmm_find_directory(directory);
+    assert(index < VMM_DIRECTORY_COUNT);
+    pt_load_directory((struct page_directory*) (directory << PAGE_OFFSET_BITS));
+    VMM_USER_TABLE_USED = VMM_DIRECTORIES[index].user_table_used;
+    ++VMM_TLB_STATS.directory_switches;
+    if (VMM_GLOBAL_PAGES)
+        ++VMM_TLB_STATS.global_switches;
+}
+
+void vmm_get_cow_stats(struct vmm_cow_stats* stats) {
+    *stats = VMM_COW_STATS;
+}
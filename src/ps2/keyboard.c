@@ -1,6 +1,7 @@
 #include "ps2/keyboard.h"
 
 #include "core/io.h"
+#include "core/idle.h"
 
 #include "interrupt/idt.h"
 #include "interrupt/pic.h"
@@ -157,7 +158,7 @@ void ps2_keyboard_get_next(uint8_t* next, bool* is_release){
     bool done = false;
     while(!done){
         done = true;
-        while(!ringbuffer_length(&ps2_keyboard_buffer));
+        while(!ringbuffer_length(&ps2_keyboard_buffer)) idle_run();
         ringbuffer_read(&ps2_keyboard_buffer, next, 1);
         log_debug("%u (0x%X)", *next, *next);
         if(*next == 0xF0){ //Release
@@ -186,7 +187,7 @@ void ps2_keyboard_get_next_char(uint8_t* next, bool* is_release){
     
     bool done = false;
     while(!done){
-        while(!ringbuffer_length(&ps2_keyboard_buffer));
+        while(!ringbuffer_length(&ps2_keyboard_buffer)) idle_run();
         ringbuffer_read(&ps2_keyboard_buffer, next, 1);
         if(*next == 0xF0){ //Release
             *is_release = true;
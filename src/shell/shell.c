@@ -8,6 +8,18 @@
 
 #include "debug/console/console.h"
 
+#include "memory/heap.h"
+#include "memory/slab.h"
+#include "memory/vmm.h"
+#include "memory/pmm.h"
+#include "memory/vm_region.h"
+#include "memory/memtag.h"
+
+#include "core/boot_module.h"
+#include "fs/tar.h"
+
+#include "debug/benchmark.h"
+
 volatile static bool loop = true;
 
 void shell_do_command(uint8_t* command, size_t length){
@@ -33,7 +45,11 @@ void shell_do_command(uint8_t* command, size_t length){
         }
     }
     
-    char* argv[argc];
+    char** argv = kmalloc(argc * sizeof(char*));
+    if(!argv){
+        console_print("Out of memory\n");
+        return;
+    }
     argv[0] = (char*) command;
     size_t j = 1;
     for(size_t i = command_length;i < length;++i){
@@ -59,12 +75,78 @@ void shell_do_command(uint8_t* command, size_t length){
             console_printf("%s", argv[1]);
         }
         console_putchar('\n');
+    }else if(!strncmp(argv[0], "slabinfo", command_length)){
+        kmem_print_stats();
+    }else if(!strncmp(argv[0], "tlbinfo", command_length)){
+        struct vmm_tlb_stats stats;
+        vmm_get_tlb_stats(&stats);
+        console_printf("invlpg: %u, full flushes: %u (global: %u), page tables freed: %u\n", stats.invlpg, stats.full_flushes, stats.global_flushes, stats.page_tables_freed);
+        console_printf("directory switches: %u (global: %u, kernel TLB refills avoided: at most %u)\n", stats.directory_switches, stats.global_switches, stats.global_switches * VMM_TLB_ENTRIES);
+    }else if(!strncmp(argv[0], "zeroinfo", command_length)){
+        struct pmm_zero_stats stats;
+        pmm_get_zero_stats(&stats);
+        console_printf("pool: %u/%u, hits: %u, synchronous: %u, idle: %u\n", stats.pool_pages, PMM_ZERO_POOL_ENTRIES, stats.pool_hits, stats.sync_zeroed, stats.idle_zeroed);
+    }else if(!strncmp(argv[0], "meminfo", command_length)){
+        memtag_print_stats();
+    }else if(!strncmp(argv[0], "allocinfo", command_length)){
+        struct pmm_latency_histogram histogram;
+        pmm_get_alloc_latency(&histogram);
+        if(!histogram.unit){
+            console_print("No allocations measured\n");
+        }else{
+            uint32_t min_log2 = histogram.min_log2;
+            for(size_t i = 0;i < PMM_LATENCY_BUCKETS;++i){
+                if(histogram.buckets[i] == 0) continue;
+                if(i == 0) console_printf("      < %7u %s: %u\n", 1U << min_log2, histogram.unit, histogram.buckets[i]);
+                else if(i == PMM_LATENCY_BUCKETS - 1) console_printf("     >= %7u %s: %u\n", 1U << (i + min_log2 - 1), histogram.unit, histogram.buckets[i]);
+                else console_printf("%7u-%7u %s: %u\n", 1U << (i + min_log2 - 1), (1U << (i + min_log2)) - 1, histogram.unit, histogram.buckets[i]);
+            }
+            console_printf("max: %u %s\n", histogram.max_time, histogram.unit);
+        }
+    }else if(!strncmp(argv[0], "vminfo", command_length)){
+        vm_space_print_stats(vm_kernel_space());
+        struct vmm_cow_stats stats;
+        vmm_get_cow_stats(&stats);
+        console_printf("clones: %u, shared: %u, copied: %u, reused: %u\n", stats.clones, stats.shared_pages, stats.copied_pages, stats.reused_pages);
+    }else if(!strncmp(argv[0], "ls", command_length)){
+        struct tar_entry entry;
+        for(size_t i = 0;i < boot_module_count();++i){
+            const struct boot_module* module = boot_module_get(i);
+            console_printf("%s: %zu bytes\n", module->name, module->size);
+            if(!module->data) continue;
+            struct tar_iterator it;
+            tar_iterator_init(&it, module->data, module->size);
+            while(tar_iterator_next(&it, &entry)){
+                if(!entry.path[0]) continue;
+                if(entry.type == TAR_ENTRY_DIRECTORY) console_printf("    %s/\n", entry.path);
+                else console_printf("    %s (%zu bytes)\n", entry.path, entry.size);
+            }
+        }
+    }else if(!strncmp(argv[0], "cat", command_length)){
+        if(argc < 2){
+            console_print("Usage: cat <file>\n");
+        }else{
+            struct tar_entry entry;
+            bool found = false;
+            for(size_t i = 0;i < boot_module_count() && !found;++i){
+                const struct boot_module* module = boot_module_get(i);
+                found = module->data && tar_find(module->data, module->size, argv[1], &entry);
+            }
+            if(found) console_write(entry.data, entry.size);
+            else console_printf("No such file '%s'\n", argv[1]);
+        }
+    }else if(!strncmp(argv[0], "membench", command_length)){
+        benchmark_mem();
+    }else if(!strncmp(argv[0], "divbench", command_length)){
+        benchmark_div();
     }else if(!strncmp(argv[0], "help", command_length)){
         console_print("'no'\n");
     }else{
         //TODO: run executables
         console_printf("Unknown command '%s'\n", argv[0]);
     }
+    
+    kfree(argv);
 }
 
 void shell_print_header(void){
@@ -89,10 +171,16 @@ void shell_loop(void){
                 console_clear_cursor();
                 console_putchar('\n');
                 size_t length = ringbuffer_length(&rbuffer);
-                uint8_t line[length+1];
-                line[length] = 0;
-                ringbuffer_read(&rbuffer, line, length);
-                shell_do_command(line, length);
+                uint8_t* line = kmalloc(length+1);
+                if(line){
+                    line[length] = 0;
+                    ringbuffer_read(&rbuffer, line, length);
+                    shell_do_command(line, length);
+                    kfree(line);
+                }else{
+                    ringbuffer_remove(&rbuffer, length);
+                    console_print("Out of memory\n");
+                }
                 if(loop) shell_print_header();
             }else if(next == 8 && ringbuffer_length(&rbuffer) > 0){
                 ringbuffer_remove(&rbuffer, 1);
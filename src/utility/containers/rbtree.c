@@ -114,6 +114,7 @@ static void rb_fix_insert(struct rb_tree* tree, struct rb_node* node) {
                 */
                 node = parent;
                 rb_rotate_left(tree, node);
+                parent = node->parent;
             }
             /*
                 Case 3: the tree is transformed as follows:
@@ -131,7 +132,7 @@ static void rb_fix_insert(struct rb_tree* tree, struct rb_node* node) {
         } else {
             // Symmetric cases
             // Note: uncle might be null
-            struct rb_node* uncle = grandparent->right;
+            struct rb_node* uncle = grandparent->left;
             if (rb_node_is_red(uncle)) {
                 // Node: uncle cannot be null.
                 // Case 1
@@ -144,6 +145,7 @@ static void rb_fix_insert(struct rb_tree* tree, struct rb_node* node) {
                 // Case 2
                 node = parent;
                 rb_rotate_right(tree, node);
+                parent = node->parent;
             }
             // Case 3
             parent->is_black = true;
@@ -154,7 +156,7 @@ static void rb_fix_insert(struct rb_tree* tree, struct rb_node* node) {
     }
 
     // We might end up with a new red root node. This is not allowed, so color it black.
-    node->is_black = true;
+    tree->root->is_black = true;
 }
 
 static void rb_swap_color(struct rb_node* a, struct rb_node* b) {
@@ -166,7 +168,7 @@ static void rb_swap_color(struct rb_node* a, struct rb_node* b) {
 // Delete an inner node by swapping it with a leaf node.
 // Returns the new node to delete (the leaf). Afterwards, `node` only
 // has a single child.
-static void rb_bst_swap(struct rb_node* node) {
+static void rb_bst_swap(struct rb_tree* tree, struct rb_node* node) {
     if (!node->left || !node->right) {
         // If the node had only one child to begin with, there is nothing to do here.
         return;
@@ -200,6 +202,8 @@ static void rb_bst_swap(struct rb_node* node) {
                 parent->left = replacement;
             else
                 parent->right = replacement;
+        } else {
+            tree->root = replacement;
         }
 
         // Fix parent of a.
@@ -245,6 +249,8 @@ static void rb_bst_swap(struct rb_node* node) {
             parent->left = replacement;
         else
             parent->right = replacement;
+    } else {
+        tree->root = replacement;
     }
 
     // `replacement` always has a parent, and is always the left child of its parent.
@@ -310,8 +316,8 @@ static void rb_fix_double_black(struct rb_tree* tree, struct rb_node* node) {
                 This automatically means that the children of the sibling and the parent are black.
                 This is resolved by first swapping the colors of the sibling and the parent,
                 and then performing a rotation on the parent in the direction of the double-black.
-                This also leads to a new double-black situation, so the iteration continues with
-                the original sibling.
+                The double-black node now has a black sibling, so the iteration continues with the
+                same node, which is then resolved by one of the other cases.
                    B            R            B
                   / \          / \          / \
                 (B)  R   =>  (B)  B   =>   R   B
@@ -326,7 +332,6 @@ static void rb_fix_double_black(struct rb_tree* tree, struct rb_node* node) {
             else
                 rb_rotate_right(tree, parent);
 
-            node = sibling;
             continue;
         } else if (rb_node_is_black(far_nephew)) {
             /*
@@ -428,7 +433,7 @@ void rb_delete(struct rb_tree* tree, struct rb_node* node) {
 
     // If the node is an inner node (including the root), replace it with a leaf node.
     // Afterward, `node` has at most one child, which may be either left or right.
-    rb_bst_swap(node);
+    rb_bst_swap(tree, node);
 
     struct rb_node* parent = node->parent;
 
@@ -496,6 +501,7 @@ void rb_move_node(struct rb_tree* tree, struct rb_node* dst, struct rb_node* src
     dst->parent = src->parent;
     dst->left = src->left;
     dst->right = src->right;
+    dst->is_black = src->is_black;
 
     if (dst->parent) {
         if (dst->parent->left == src)
@@ -534,6 +540,21 @@ struct rb_node* rb_find_by(struct rb_tree* tree, rb_find_cmp_fn cmp, void* value
     return NULL;
 }
 
+struct rb_node* rb_lower_bound_by(struct rb_tree* tree, rb_find_cmp_fn cmp, void* value) {
+    struct rb_node* result = NULL;
+    struct rb_node* current = tree->root;
+    while (current) {
+        if (cmp(value, current) <= 0) {
+            result = current;
+            current = current->left;
+        } else {
+            current = current->right;
+        }
+    }
+
+    return result;
+}
+
 void rb_iterator_init(struct rb_iterator* it, struct rb_tree* tree) {
     it->next = tree->root;
     it->node = NULL;
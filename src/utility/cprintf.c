@@ -8,7 +8,35 @@
 #include <limits.h>
 
 #define UINTMAX_DIGITS 20 // log10(uintmax_t) == 20 digits
-#define UINTMAX_NIBBLES (sizeof(uintmax_t) * 2)
+
+// The largest power of 10 that fits in 32 bits, and the number of digits of a remainder modulo it.
+#define UINTMAX_CHUNK (1000000000U)
+#define UINTMAX_CHUNK_DIGITS (9U)
+
+// The size of the buffer in which a numeric field is built, so that it can be written with a single call
+// to the callback. Padding beyond this is written separately.
+#define FORMAT_FIELD_SIZE 64
+
+// The longest prefix of a numeric field, which is "0x" for pointers.
+#define FORMAT_PREFIX_MAX 2
+
+_Static_assert(FORMAT_FIELD_SIZE > UINTMAX_DIGITS + FORMAT_PREFIX_MAX, "numeric fields must fit in the field buffer");
+
+// The decimal representations of 0 to 99, two characters each.
+static const char DECIMAL_PAIRS[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char HEX_DIGITS_LOWER[16] = "0123456789abcdef";
+static const char HEX_DIGITS_UPPER[16] = "0123456789ABCDEF";
 
 enum format_length {
     LENGTH_CHAR,
@@ -30,45 +58,124 @@ struct format_options {
     char conversion_specifier;
 };
 
-static int write_uint_buf(cprintf_write_cbk cbk, void* ctx, const struct format_options* opts, const char* buf, size_t len) {
+// Write `count` copies of `c`, in as few calls to the callback as the buffer allows.
+static int write_padding(cprintf_write_cbk cbk, void* ctx, char c, size_t count) {
+    char buf[FORMAT_FIELD_SIZE];
+    memset(buf, c, count < FORMAT_FIELD_SIZE ? count : FORMAT_FIELD_SIZE);
+
+    while (count > 0) {
+        size_t size = count < FORMAT_FIELD_SIZE ? count : FORMAT_FIELD_SIZE;
+        int result = cbk(ctx, buf, size);
+        if (result) {
+            return result;
+        }
+        count -= size;
+    }
+
+    return 0;
+}
+
+// Write the number of which the digits were formatted in the end of `buf`, starting at `digits`. `prefix`
+// comes before the padding, which only counts the digits towards the minimum width. The field is written
+// with a single call to the callback, unless the padding does not fit in the buffer.
+static int write_field(cprintf_write_cbk cbk, void* ctx, const struct format_options* opts, const char* prefix, char* buf, char* digits) {
+    char* end = buf + FORMAT_FIELD_SIZE;
+    size_t len = end - digits;
+    size_t padding = opts->min_width > len ? opts->min_width - len : 0;
+    size_t prefix_len = strlen(prefix);
     char leading = opts->flags.leading_zeros ? '0' : ' ';
-    for (size_t i = len; i < opts->min_width; ++i) {
-        int result = cbk(ctx, &leading, 1);
+
+    size_t room = digits - buf - FORMAT_PREFIX_MAX;
+    if (padding > room) {
+        // The prefix and the padding that does not fit are written first.
+        int result = cbk(ctx, prefix, prefix_len);
+        if (result) {
+            return result;
+        }
+
+        result = write_padding(cbk, ctx, leading, padding - room);
         if (result) {
             return result;
         }
+
+        prefix_len = 0;
+        padding = room;
+    }
+
+    digits -= padding;
+    memset(digits, leading, padding);
+
+    digits -= prefix_len;
+    for (size_t i = 0; i < prefix_len; ++i) {
+        digits[i] = prefix[i];
     }
 
-    return cbk(ctx, buf, len);
+    return cbk(ctx, digits, end - digits);
 }
 
-static int format_uint(cprintf_write_cbk cbk, void* ctx, const struct format_options* opts, uintmax_t value) {
-    _Static_assert(sizeof(uintmax_t) == sizeof(uint64_t), "format_uint expects uintmax_t == uint64_t");
-    char buf[UINTMAX_DIGITS] = {0};
-    size_t digit = UINTMAX_DIGITS;
+// Write the decimal digits of `value` before `end`, two at a time, padded with zeros to at least
+// `min_digits` digits. Returns the first digit.
+static char* format_decimal32(char* end, uint32_t value, size_t min_digits) {
+    char* start = end - min_digits;
+
+    while (value >= 100) {
+        uint32_t pair;
+        value = udivmod32_100(value, &pair);
+        end -= 2;
+        end[0] = DECIMAL_PAIRS[pair * 2];
+        end[1] = DECIMAL_PAIRS[pair * 2 + 1];
+    }
+
+    if (value >= 10) {
+        end -= 2;
+        end[0] = DECIMAL_PAIRS[value * 2];
+        end[1] = DECIMAL_PAIRS[value * 2 + 1];
+    } else {
+        *--end = '0' + (char) value;
+    }
+
+    while (end > start) {
+        *--end = '0';
+    }
 
-    do {
-        uint64_t rem;
-        value = udivmod64(value, 10, &rem);
-        buf[--digit] = '0' + (char) rem;
-    } while (value > 0);
+    return end;
+}
+
+static int format_uint(cprintf_write_cbk cbk, void* ctx, const struct format_options* opts, const char* prefix, uintmax_t value) {
+    _Static_assert(sizeof(uintmax_t) == sizeof(uint64_t), "format_uint expects uintmax_t == uint64_t");
+    char buf[FORMAT_FIELD_SIZE];
+    char* digits = buf + FORMAT_FIELD_SIZE;
+
+    // Values that do not fit in 32 bits are split into chunks of 9 digits with a 64-bit division, so that
+    // the digits themselves can be produced with cheap 32-bit divisions.
+    while (value > UINT32_MAX) {
+        uint64_t chunk;
+        value = udivmod64(value, UINTMAX_CHUNK, &chunk);
+        digits = format_decimal32(digits, (uint32_t) chunk, UINTMAX_CHUNK_DIGITS);
+    }
 
-    return write_uint_buf(cbk, ctx, opts, &buf[digit], UINTMAX_DIGITS - digit);
+    digits = format_decimal32(digits, (uint32_t) value, 1);
+    return write_field(cbk, ctx, opts, prefix, buf, digits);
 }
 
-static int format_hex(cprintf_write_cbk cbk, void* ctx, const struct format_options* opts, uintmax_t value) {
-    char buf[UINTMAX_NIBBLES] = {0};
-    bool upper = opts->conversion_specifier == 'X';
-    char letter_base = (upper ? 'A' : 'a') - 10;
+static int format_hex(cprintf_write_cbk cbk, void* ctx, const struct format_options* opts, const char* prefix, uintmax_t value) {
+    char buf[FORMAT_FIELD_SIZE];
+    char* digits = buf + FORMAT_FIELD_SIZE;
+    const char* hex_digits = opts->conversion_specifier == 'X' ? HEX_DIGITS_UPPER : HEX_DIGITS_LOWER;
 
-    size_t digit = UINTMAX_NIBBLES;
-    do {
-        char nibble = (char)(value & 0xF);
-        buf[--digit] = nibble + (nibble < 10 ? '0' : letter_base);
-        value >>= 4;
-    } while (value > 0);
+    // Two digits per byte, except for a leading zero.
+    while (value > 0xFF) {
+        *--digits = hex_digits[value & 0xF];
+        *--digits = hex_digits[(value >> 4) & 0xF];
+        value >>= 8;
+    }
 
-    return write_uint_buf(cbk, ctx, opts, &buf[digit], UINTMAX_NIBBLES - digit);
+    *--digits = hex_digits[value & 0xF];
+    if (value > 0xF) {
+        *--digits = hex_digits[value >> 4];
+    }
+
+    return write_field(cbk, ctx, opts, prefix, buf, digits);
 }
 
 static bool parse_format_options(const char* format, struct format_options* opts, const char** format_end) {
@@ -169,15 +276,22 @@ static uintmax_t read_uint_arg(va_list* args, enum format_length type) {
 
 int vcprintf(cprintf_write_cbk cbk, void* context, const char* format, va_list args) {
     while (*format) {
-        const char c = *format++;
-        if (c != '%') {
-            int result = cbk(context, &c, 1);
+        if (*format != '%') {
+            // Text up to the next conversion is written at once.
+            const char* text = format;
+            while (*format && *format != '%') {
+                ++format;
+            }
+
+            int result = cbk(context, text, format - text);
             if (result) {
                 return result;
             }
             continue;
         }
 
+        ++format;
+
         struct format_options opts;
         if (!parse_format_options(format, &opts, &format)) {
             return SIZE_MAX;
@@ -197,16 +311,12 @@ int vcprintf(cprintf_write_cbk cbk, void* context, const char* format, va_list a
                 if (value < 0) {
                     // Manually perform the signed two's complement abs to
                     // avoid overflow problems
-                    int result = cbk(context, "-", 1);
-                    if (result) {
-                        return result;
-                    }
-                    result = format_uint(cbk, context, &opts, ~((uintmax_t) value) + 1);
+                    int result = format_uint(cbk, context, &opts, "-", ~((uintmax_t) value) + 1);
                     if (result) {
                         return result;
                     }
                 } else {
-                    int result = format_uint(cbk, context, &opts, value);
+                    int result = format_uint(cbk, context, &opts, "", value);
                     if (result) {
                         return result;
                     }
@@ -215,7 +325,7 @@ int vcprintf(cprintf_write_cbk cbk, void* context, const char* format, va_list a
             }
             case 'u': {
                 uintmax_t value = read_uint_arg(&args, opts.length_modifier);
-                int result = format_uint(cbk, context, &opts, value);
+                int result = format_uint(cbk, context, &opts, "", value);
                 if (result) {
                     return result;
                 }
@@ -224,7 +334,7 @@ int vcprintf(cprintf_write_cbk cbk, void* context, const char* format, va_list a
             case 'x':
             case 'X': {
                 uintmax_t value = read_uint_arg(&args, opts.length_modifier);
-                int result = format_hex(cbk, context, &opts, value);
+                int result = format_hex(cbk, context, &opts, "", value);
                 if (result) {
                     return result;
                 }
@@ -232,14 +342,10 @@ int vcprintf(cprintf_write_cbk cbk, void* context, const char* format, va_list a
             }
             case 'p': {
                 void* ptr = va_arg(args, void*);
-                int result = cbk(context, "0x", 2);
-                if (result) {
-                    return result;
-                }
                 opts.min_width = sizeof(intptr_t) * 2;
                 opts.flags.leading_zeros = true;
                 opts.conversion_specifier = 'X';
-                result = format_hex(cbk, context, &opts, (uintptr_t) ptr);
+                int result = format_hex(cbk, context, &opts, "0x", (uintptr_t) ptr);
                 if (result) {
                     return result;
                 }
@@ -248,8 +354,8 @@ int vcprintf(cprintf_write_cbk cbk, void* context, const char* format, va_list a
             case 's': {
                 const char* str = va_arg(args, const char*);
                 size_t len = strlen(str);
-                for (size_t i = len; i < opts.min_width; ++i) {
-                    int result = cbk(context, " ", 1);
+                if (len < opts.min_width) {
+                    int result = write_padding(cbk, context, ' ', opts.min_width - len);
                     if (result) {
                         return result;
                     }
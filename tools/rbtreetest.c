@@ -0,0 +1,180 @@
+// Randomized test of the kernel red-black tree. Nodes with keys from a small range, so that there are many
+// duplicates, are inserted, deleted and moved at random. After every operation the red-black properties
+// are checked, and the lookups and iterators are compared against an in-order walk of the tree. Build and
+// run with `make rbtreetest`.
+
+#include "utility/containers/rbtree.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#define RBTREETEST_NODES (300)
+#define RBTREETEST_KEYS (100)
+#define RBTREETEST_STEPS (2000)
+#define RBTREETEST_DEFAULT_ROUNDS (500L)
+
+struct test_node {
+    struct rb_node node;
+    int key;
+    bool in_tree;
+};
+
+static struct test_node NODES[RBTREETEST_NODES];
+static size_t NODES_IN_TREE;
+
+// The nodes of the tree in in-order, as found by walking the child pointers.
+static struct rb_node* ORDER[RBTREETEST_NODES];
+static size_t ORDER_LENGTH;
+
+static long ROUND;
+
+// The kernel sources report failed assertions through this.
+void assert_report(const char* expr, const char* file, const char* function, unsigned line) {
+    fprintf(stderr, "%s:%u: %s: assertion '%s' failed in round %ld\n", file, line, function, expr, ROUND);
+    exit(1);
+}
+
+void assert_report_unreachable(const char* file, const char* function, unsigned line) {
+    fprintf(stderr, "%s:%u: %s: unreachable code reached in round %ld\n", file, line, function, ROUND);
+    exit(1);
+}
+
+static void fail(const char* what) {
+    fprintf(stderr, "%s in round %ld\n", what, ROUND);
+    exit(1);
+}
+
+static int node_key(struct rb_node* node) {
+    return ((struct test_node*) node)->key;
+}
+
+static int compare_nodes(struct rb_node* lhs, struct rb_node* rhs) {
+    return (node_key(lhs) > node_key(rhs)) - (node_key(lhs) < node_key(rhs));
+}
+
+static int compare_key(void* key, struct rb_node* node) {
+    int value = *(int*) key;
+    return (value > node_key(node)) - (value < node_key(node));
+}
+
+// Check the subtree rooted at `node`, append its nodes to `ORDER`, and return its black height.
+static size_t check_subtree(struct rb_node* node, struct rb_node* parent) {
+    if (!node)
+        return 1;
+
+    if (node->parent != parent)
+        fail("Wrong parent pointer");
+    if (!node->is_black && ((node->left && !node->left->is_black) || (node->right && !node->right->is_black)))
+        fail("Red node with a red child");
+    if ((node->left && compare_nodes(node->left, node) > 0) || (node->right && compare_nodes(node->right, node) < 0))
+        fail("Children out of order");
+
+    size_t left_height = check_subtree(node->left, node);
+    if (ORDER_LENGTH == RBTREETEST_NODES)
+        fail("Cycle in the tree");
+    ORDER[ORDER_LENGTH++] = node;
+    size_t right_height = check_subtree(node->right, node);
+
+    if (left_height != right_height)
+        fail("Unequal black heights");
+    return left_height + node->is_black;
+}
+
+static void check_tree(struct rb_tree* tree) {
+    if (tree->root && !tree->root->is_black)
+        fail("Red root");
+
+    ORDER_LENGTH = 0;
+    check_subtree(tree->root, NULL);
+    if (ORDER_LENGTH != NODES_IN_TREE || tree->num_nodes != NODES_IN_TREE)
+        fail("Wrong number of nodes");
+
+    for (size_t i = 0; i < ORDER_LENGTH; ++i) {
+        if (!((struct test_node*) ORDER[i])->in_tree)
+            fail("Removed node still in the tree");
+        if (i > 0 && compare_nodes(ORDER[i - 1], ORDER[i]) > 0)
+            fail("Nodes out of order");
+    }
+
+    struct rb_iterator it;
+    rb_iterator_init(&it, tree);
+    for (size_t i = 0; i < ORDER_LENGTH; ++i) {
+        if (!rb_iterator_next(&it) || it.node != ORDER[i])
+            fail("Iterator does not visit the nodes in order");
+    }
+    if (rb_iterator_next(&it))
+        fail("Iterator does not stop at the end");
+}
+
+// Compare the lookups for `key` against `ORDER`.
+static void check_lookups(struct rb_tree* tree, int key) {
+    size_t first = 0;
+    while (first < ORDER_LENGTH && node_key(ORDER[first]) < key)
+        ++first;
+
+    struct rb_node* lower_bound = rb_lower_bound_by(tree, compare_key, &key);
+    if (lower_bound != (first < ORDER_LENGTH ? ORDER[first] : NULL))
+        fail("rb_lower_bound_by does not return the first node that is not less");
+
+    struct rb_node* found = rb_find_by(tree, compare_key, &key);
+    bool present = first < ORDER_LENGTH && node_key(ORDER[first]) == key;
+    if (present ? !found || node_key(found) != key : found != NULL)
+        fail("rb_find_by does not find the key");
+
+    if (!lower_bound)
+        return;
+
+    struct rb_iterator it;
+    rb_iterator_init_at(&it, lower_bound);
+    for (size_t i = first; i < ORDER_LENGTH; ++i) {
+        if (!rb_iterator_next(&it) || it.node != ORDER[i])
+            fail("Iterator started at a node does not visit the following nodes in order");
+    }
+    if (rb_iterator_next(&it))
+        fail("Iterator started at a node does not stop at the end");
+}
+
+static void run_round(void) {
+    struct rb_tree tree;
+    rb_init(&tree, compare_nodes);
+    NODES_IN_TREE = 0;
+    for (size_t i = 0; i < RBTREETEST_NODES; ++i) {
+        NODES[i].key = rand() % RBTREETEST_KEYS;
+        NODES[i].in_tree = false;
+    }
+
+    for (size_t step = 0; step < RBTREETEST_STEPS; ++step) {
+        struct test_node* node = &NODES[rand() % RBTREETEST_NODES];
+        struct test_node* other = &NODES[rand() % RBTREETEST_NODES];
+        if (node->in_tree && !other->in_tree && rand() % 8 == 0) {
+            other->key = node->key;
+            rb_move_node(&tree, &other->node, &node->node);
+            other->in_tree = true;
+            node->in_tree = false;
+        } else if (node->in_tree) {
+            rb_delete(&tree, &node->node);
+            node->in_tree = false;
+            --NODES_IN_TREE;
+        } else {
+            rb_insert(&tree, &node->node);
+            node->in_tree = true;
+            ++NODES_IN_TREE;
+        }
+
+        check_tree(&tree);
+        check_lookups(&tree, rand() % (RBTREETEST_KEYS + 2) - 1);
+    }
+}
+
+int main(int argc, char** argv) {
+    long rounds = argc > 1 ? atol(argv[1]) : RBTREETEST_DEFAULT_ROUNDS;
+    unsigned seed = argc > 2 ? (unsigned) atol(argv[2]) : 1;
+    srand(seed);
+
+    for (ROUND = 0; ROUND < rounds; ++ROUND)
+        run_round();
+
+    printf("%ld rounds passed (seed %u)\n", rounds, seed);
+    return 0;
+}
@@ -0,0 +1,164 @@
+// Randomized differential test of the kernel string and memory functions against the host C library.
+// The kernel versions read whole words, so the strings and buffers are also placed right before a
+// PROT_NONE page: reading past their end would fault. Build and run with `make stringtest`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// The kernel sources are compiled with their functions renamed to these.
+size_t k_strlen(const char* str);
+int k_strcmp(const char* lhs, const char* rhs);
+int k_strncmp(const char* lhs, const char* rhs, size_t count);
+int k_memcmp(const void* lhs, const void* rhs, size_t count);
+void* k_memchr(const void* ptr, int ch, size_t count);
+void* k_memset(void* dest, int ch, size_t count);
+void* k_memcpy(void* restrict dest, const void* restrict src, size_t count);
+void* k_memmove(void* dest, const void* src, size_t count);
+
+#define STRINGTEST_MAX_LENGTH (80)
+#define STRINGTEST_DEFAULT_ITERATIONS (1000000L)
+
+// The arena is two readable pages followed by a guard page.
+static uint8_t* ARENA;
+static uint8_t* GUARD;
+static size_t PAGE_SIZE;
+
+static int sign(int value) {
+    return (value > 0) - (value < 0);
+}
+
+static size_t random_below(size_t bound) {
+    return bound ? (size_t) rand() % bound : 0;
+}
+
+// Pick a place for `size` bytes: either ending right before the guard page, or at a random offset.
+static uint8_t* random_place(size_t size) {
+    if (rand() & 1)
+        return GUARD - size;
+    return ARENA + random_below(2 * PAGE_SIZE - size);
+}
+
+static int overlaps(const uint8_t* a, size_t a_size, const uint8_t* b, size_t b_size) {
+    return a < b + b_size && b < a + a_size;
+}
+
+// Fill a string from a small alphabet so that comparisons often run deep, with some bytes above 0x7F to
+// catch signed comparisons.
+static void random_string(uint8_t* str, size_t length, const uint8_t* like, size_t like_length, int alphabet) {
+    for (size_t i = 0; i < length; ++i) {
+        if (i < like_length && rand() % 4)
+            str[i] = like[i];
+        else if (rand() % 8 == 0)
+            str[i] = 0x80 + random_below(0x80);
+        else
+            str[i] = 'a' + random_below(alphabet);
+    }
+    str[length] = 0;
+}
+
+static int fail(const char* function, long iteration) {
+    fprintf(stderr, "%s differs from the host in iteration %ld\n", function, iteration);
+    return 1;
+}
+
+static int test_strings(long iteration) {
+    size_t lhs_length = random_below(STRINGTEST_MAX_LENGTH);
+    size_t rhs_length = random_below(STRINGTEST_MAX_LENGTH);
+    uint8_t* lhs = random_place(lhs_length + 1);
+    uint8_t* rhs = random_place(rhs_length + 1);
+    if (overlaps(lhs, lhs_length + 1, rhs, rhs_length + 1))
+        return 0;
+
+    int alphabet = 1 + random_below(3);
+    random_string(lhs, lhs_length, NULL, 0, alphabet);
+    random_string(rhs, rhs_length, lhs, lhs_length, alphabet);
+
+    const char* lhs_str = (const char*) lhs;
+    const char* rhs_str = (const char*) rhs;
+    if (k_strlen(lhs_str) != strlen(lhs_str))
+        return fail("strlen", iteration);
+    if (sign(k_strcmp(lhs_str, rhs_str)) != sign(strcmp(lhs_str, rhs_str)))
+        return fail("strcmp", iteration);
+
+    size_t count = random_below(STRINGTEST_MAX_LENGTH + 8);
+    if (sign(k_strncmp(lhs_str, rhs_str, count)) != sign(strncmp(lhs_str, rhs_str, count)))
+        return fail("strncmp", iteration);
+
+    // Unlike the string functions, these may only read `count` bytes, which end right before the guard page
+    // for buffers placed there.
+    size_t shortest = lhs_length < rhs_length ? lhs_length : rhs_length;
+    count = random_below(shortest + 2);
+    if (sign(k_memcmp(lhs, rhs, count)) != sign(memcmp(lhs, rhs, count)))
+        return fail("memcmp", iteration);
+
+    int ch = rand() % 3 ? lhs[random_below(lhs_length + 1)] : (int) random_below(0x100);
+    if (k_memchr(lhs, ch, lhs_length + 1) != memchr(lhs, ch, lhs_length + 1))
+        return fail("memchr", iteration);
+
+    return 0;
+}
+
+static int test_memory(long iteration) {
+    static uint8_t expected[2 * STRINGTEST_MAX_LENGTH];
+    size_t count = random_below(STRINGTEST_MAX_LENGTH);
+    uint8_t* dest = random_place(count);
+
+    for (size_t i = 0; i < count; ++i)
+        dest[i] = rand();
+
+    int ch = rand();
+    memset(expected, ch, count);
+    if (k_memset(dest, ch, count) != dest || memcmp(dest, expected, count))
+        return fail("memset", iteration);
+
+    uint8_t* src = random_place(count);
+    if (!overlaps(dest, count, src, count)) {
+        memcpy(expected, src, count);
+        if (k_memcpy(dest, src, count) != dest || memcmp(dest, expected, count))
+            return fail("memcpy", iteration);
+    }
+
+    // Move within a window that ends at the guard page, so that both directions overlap.
+    uint8_t* window = GUARD - 2 * STRINGTEST_MAX_LENGTH;
+    for (size_t i = 0; i < 2 * STRINGTEST_MAX_LENGTH; ++i)
+        window[i] = rand();
+    dest = window + random_below(STRINGTEST_MAX_LENGTH);
+    src = window + random_below(STRINGTEST_MAX_LENGTH);
+    memcpy(expected, window, 2 * STRINGTEST_MAX_LENGTH);
+    memmove(expected + (dest - window), expected + (src - window), count);
+    if (k_memmove(dest, src, count) != dest || memcmp(window, expected, 2 * STRINGTEST_MAX_LENGTH))
+        return fail("memmove", iteration);
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : STRINGTEST_DEFAULT_ITERATIONS;
+    unsigned seed = argc > 2 ? (unsigned) atol(argv[2]) : 1;
+    srand(seed);
+
+    PAGE_SIZE = sysconf(_SC_PAGESIZE);
+    ARENA = mmap(NULL, 3 * PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ARENA == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+
+    GUARD = ARENA + 2 * PAGE_SIZE;
+    if (mprotect(GUARD, PAGE_SIZE, PROT_NONE)) {
+        perror("mprotect");
+        return 1;
+    }
+
+    for (long i = 0; i < iterations; ++i) {
+        if (test_strings(i) || test_memory(i))
+            return 1;
+    }
+
+    printf("%ld iterations passed (seed %u)\n", iterations, seed);
+    return 0;
+}